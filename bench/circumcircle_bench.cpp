@@ -0,0 +1,150 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Benchmark for the circumcircle code. Makes a bunch of random triangles,
+ * shaped like the ones the generator sees (small and roughly equilateral),
+ * and computes their circumcircles with circumcircle_center, circumcircle and
+ * circle_batch at every SIMD level this CPU supports. Prints nanoseconds per
+ * circle, and checks that every path gives exactly the same answer, because
+ * the generator depends on that.
+ *
+ * Usage: circumcircle_bench [<triangle count>] [<rounds>]
+ */
+
+#include "circumcircle.hpp"
+
+#include <cstring>
+
+using bench_clock = std::chrono::steady_clock;
+
+static double ns_per_circle(bench_clock::time_point start, size_t circles)
+{
+	std::chrono::duration<double, std::nano> elapsed = bench_clock::now() - start;
+	return elapsed.count() / circles;
+}
+
+static bool same(double a, double b)
+{
+	return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+int main(int argc, char **argv)
+{
+	size_t count  = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4096;
+	size_t rounds = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000;
+
+	if (count == 0 || rounds == 0) {
+		std::cerr << "Usage: circumcircle_bench [<triangle count>] [<rounds>]\n";
+		return 1;
+	}
+
+	std::mt19937 rng { 42 };
+	std::uniform_real_distribution<double> unit { 0.0, 1.0 };
+	std::uniform_real_distribution<double> jitter { -0.3, 0.3 };
+
+	std::vector<vec2> points(3 * count);
+
+	for (size_t i = 0; i < count; i++) {
+		vec2 p { unit(rng), unit(rng) };
+		double size = 1e-3;
+
+		points[3*i + 0] = p;
+		points[3*i + 1] = p + size * vec2 { 1.0 + jitter(rng), jitter(rng) };
+		points[3*i + 2] = p + size * vec2 { 0.5 + jitter(rng), 0.866 + jitter(rng) };
+	}
+
+	// Something to keep the compiler from throwing the results away
+	double sink = 0;
+
+	auto start = bench_clock::now();
+
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < count; i++) {
+			sink += circumcircle_center(points[3*i], points[3*i + 1], points[3*i + 2]).x;
+		}
+	}
+
+	fprintf(stderr, "%-20s %8.2f ns/circle\n", "circumcircle_center", ns_per_circle(start, rounds * count));
+
+	std::vector<vec2> centers(count);
+	std::vector<double> r2s(count);
+
+	start = bench_clock::now();
+
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < count; i++) {
+			circumcircle(points[3*i], points[3*i + 1], points[3*i + 2], centers[i], r2s[i]);
+		}
+	}
+
+	fprintf(stderr, "%-20s %8.2f ns/circle\n", "circumcircle", ns_per_circle(start, rounds * count));
+
+	circle_batch batch;
+
+	start = bench_clock::now();
+
+	for (size_t r = 0; r < rounds; r++) {
+		batch.clear();
+
+		for (size_t i = 0; i < count; i++) {
+			batch.push(points[3*i], points[3*i + 1], points[3*i + 2]);
+		}
+	}
+
+	fprintf(stderr, "%-20s %8.2f ns/circle\n", "circle_batch push", ns_per_circle(start, rounds * count));
+
+	bool ok = true;
+
+	for (int l = (int)simd_level::scalar; l <= (int)best_simd_level(); l++) {
+		auto level = (simd_level)l;
+
+		batch.clear();
+
+		for (size_t i = 0; i < count; i++) {
+			batch.push(points[3*i], points[3*i + 1], points[3*i + 2]);
+		}
+
+		// Only the compute part, filling the batch costs the same either way
+		start = bench_clock::now();
+
+		for (size_t r = 0; r < rounds; r++) {
+			batch.compute(level);
+			sink += batch.r2(0);
+		}
+
+		auto name = std::string("circle_batch/") + simd_level_name(level);
+		fprintf(stderr, "%-20s %8.2f ns/circle\n", name.c_str(), ns_per_circle(start, rounds * count));
+
+		for (size_t i = 0; i < count; i++) {
+			auto c = batch.center(i);
+
+			if (!same(c.x, centers[i].x) || !same(c.y, centers[i].y) || !same(batch.r2(i), r2s[i])) {
+				std::cerr << name << " differs from circumcircle for triangle " << i << "\n";
+				ok = false;
+				break;
+			}
+		}
+	}
+
+	if (sink == 12345.0) std::cerr << "";
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,378 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Benchmark for the generator. Runs the generator for a range of point counts
+ * (powers of four, 4K to 16M by default) and records how long each phase of
+ * the algorithm took, along with points per second, peak memory usage and how
+ * big the priority queue got. The results are printed as a table and written
+ * to a JSON file, so you can diff them between CGAL versions or whatever.
+ *
+ * With the tiled engine, which isn't exact, every run also generates the same
+ * set with the compact engine and compares the two (see measure_quality), at a
+ * few prefix sizes. That part isn't in the timings.
+ *
+ * Usage: ivs_bench [options] [<results.json>]
+ */
+
+#include "ivs.hpp"
+
+#include <getopt.h>
+#include <cstring>
+
+struct bench_options {
+	uint32_t min_count;
+	uint32_t max_count;
+	uint32_t rng_seed;
+	uint32_t seed_count;
+	point_format format;
+	ivs_engine engine;
+	ivs_queue queue;
+	uint32_t threads;
+	uint32_t tiles;
+	std::string output_file;
+	std::string results_file;
+
+	bench_options()
+		: min_count { 4096 }
+		, max_count { 16 * 1024 * 1024 }
+		, rng_seed   { 42 }
+		, seed_count { 3 }
+		, format { point_format::binary }
+		, engine { ivs_engine::cgal }
+		, queue { ivs_queue::heap }
+		, threads { 1 }
+		, tiles { 8 }
+		, output_file  { "/dev/null" }
+		, results_file { "ivs_bench.json" }
+	{
+	}
+};
+
+/**
+ * The tiled engine against the exact one, for one prefix size.
+ */
+struct quality_check {
+	uint32_t point_count;
+	set_quality exact;
+	set_quality tiled;
+};
+
+struct bench_result {
+	uint32_t point_count;
+	ivs_stats stats;
+	double points_per_second;
+	std::vector<quality_check> quality;
+};
+
+static void print_help()
+{
+	std::cout << R"HELP(IVS generator benchmark
+
+Usage: ivs_bench [options] [<results.json>]
+
+Runs the generator for every power of four between the minimum and maximum
+point count and writes the timings to <results.json> (default ivs_bench.json).
+
+Options:
+    -h, --help                  Print this help text
+
+        --min <n>               Smallest point count (default 4096)
+        --max <n>               Largest point count (default 16777216)
+        --seed <n>              Seed for RNG
+    -c, --seed-count <n>        Number of initial seed points (default = 3)
+        --format <fmt>          Point format written in the output phase
+                                (text, binary or binary32, default binary)
+        --output <file>         Where to write the points (default /dev/null)
+        --engine <engine>       Triangulation to use (cgal, compact or
+                                tiled, default cgal). Tiled runs are also
+                                compared to the exact set
+        --tiles <n>             Tiles on each side for the tiled engine
+                                (default 8)
+        --queue <queue>         Priority queue to use (heap or bucket,
+                                default heap)
+    -j, --threads <n>           Number of threads (default 1, 0 = one per core)
+)HELP";
+}
+
+static bench_result run(const bench_options &bopts, uint32_t point_count)
+{
+	bench_result result;
+	result.point_count = point_count;
+
+	std::ofstream out { bopts.output_file, std::ios::out | std::ios::binary };
+
+	point_file_header header { point_count, bopts.rng_seed, bopts.seed_count };
+	auto writer = make_point_writer(bopts.format, out, header);
+
+	ivs_config config;
+	config.point_count = point_count;
+	config.seeds = make_seeds(bopts.rng_seed, bopts.seed_count);
+	config.engine = bopts.engine;
+	config.queue = bopts.queue;
+	config.threads = bopts.threads;
+	config.tiles = bopts.tiles;
+	config.stats = &result.stats;
+
+	bool tiled = bopts.engine == ivs_engine::tiled;
+	std::vector<vec2> points;
+
+	if (tiled) {
+		points.reserve(point_count);
+	}
+
+	reset_peak_rss();
+
+	using namespace std::chrono;
+
+	// Timed here rather than taken from the stats, since the generator never
+	// fills those in when they're compiled out (IVS_STATS=OFF)
+	auto generate_start = steady_clock::now();
+
+	generate_ivs(config, [&](uint32_t, vec2 point) {
+		writer->write(point);
+		if (tiled) points.push_back(point);
+	});
+
+	auto flush_start = steady_clock::now();
+
+	// The final flush is part of the output too
+	writer->flush();
+
+	auto flush_end = steady_clock::now();
+
+	result.stats.output += duration<double>(flush_end - flush_start).count();
+	result.stats.total = duration<double>(flush_end - generate_start).count();
+
+	result.points_per_second = point_count / result.stats.total;
+	result.stats.peak_rss = peak_rss();
+
+	if (tiled) {
+		ivs_config exact = config;
+		exact.engine = ivs_engine::compact;
+		exact.stats = nullptr;
+
+		auto reference = generate_ivs(exact);
+
+		for (uint32_t count : { point_count / 64, point_count / 16, point_count / 4, point_count }) {
+			if (count < 64) continue;
+
+			result.quality.push_back(quality_check {
+				count,
+				measure_quality(reference, count, bopts.seed_count),
+				measure_quality(points, count, bopts.seed_count) });
+		}
+	}
+
+	return result;
+}
+
+static void write_results(const bench_options &bopts, const std::vector<bench_result> &results)
+{
+	std::ofstream out { bopts.results_file };
+
+	out << std::setprecision(9);
+	out << "{\n";
+#ifdef CGAL_VERSION_STR
+	out << "  \"cgal_version\": \"" << CGAL_VERSION_STR << "\",\n";
+#endif
+	out << "  \"engine\": \"" << engine_name(bopts.engine) << "\",\n";
+
+	if (bopts.engine == ivs_engine::tiled) {
+		out << "  \"tiles\": " << bopts.tiles << ",\n";
+	}
+
+	out << "  \"queue\": \"" << (bopts.queue == ivs_queue::bucket ? "bucket" : "heap") << "\",\n";
+	out << "  \"runs\": [\n";
+
+	for (size_t i = 0; i < results.size(); i++) {
+		const auto &r = results[i];
+
+		out << "    {\n"
+			<< "      \"point_count\": " << r.point_count << ",\n"
+			<< "      \"points_per_second\": " << r.points_per_second << ",\n";
+
+		if (!r.quality.empty()) {
+			out << "      \"quality\": [\n";
+
+			for (size_t k = 0; k < r.quality.size(); k++) {
+				const auto &q = r.quality[k];
+
+				out << "        {\n"
+					<< "          \"point_count\": " << q.point_count << ",\n"
+					<< "          \"exact_min_distance\": " << q.exact.min_distance << ",\n"
+					<< "          \"tiled_min_distance\": " << q.tiled.min_distance << ",\n"
+					<< "          \"exact_covering_radius\": " << q.exact.covering_radius << ",\n"
+					<< "          \"tiled_covering_radius\": " << q.tiled.covering_radius << "\n"
+					<< "        }" << (k + 1 < r.quality.size() ? "," : "") << "\n";
+			}
+
+			out << "      ],\n";
+		}
+
+		write_stats_json(out, r.stats, "      ");
+
+		out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+
+	out << "  ]\n}\n";
+}
+
+static bool parse_options(int argc, char **argv, bench_options &bopts)
+{
+	static const struct option longopts[]
+	{
+		{ "help",       no_argument,       0, 'h' },
+		{ "min",        required_argument, 0, 'm' },
+		{ "max",        required_argument, 0, 'M' },
+		{ "seed",       required_argument, 0, 'e' },
+		{ "seed-count", required_argument, 0, 'c' },
+		{ "format",     required_argument, 0, 't' },
+		{ "output",     required_argument, 0, 'O' },
+		{ "engine",     required_argument, 0, 'g' },
+		{ "queue",      required_argument, 0, 'u' },
+		{ "threads",    required_argument, 0, 'j' },
+		{ "tiles",      required_argument, 0, 'T' },
+		{ 0, 0, 0, 0 }
+	};
+
+	while (1) {
+		int optindex;
+		int c = getopt_long(argc, argv, "hc:j:", longopts, &optindex);
+
+		if (c == -1) break;
+
+		try {
+			switch (c) {
+			case 'h':
+				print_help();
+				exit(0);
+			case 'm':
+				bopts.min_count = std::stoul(optarg);
+				break;
+			case 'M':
+				bopts.max_count = std::stoul(optarg);
+
+				if (bopts.max_count > MAX_POINT_COUNT) {
+					std::cerr << "At most " << MAX_POINT_COUNT << " points per set" << std::endl;
+					return false;
+				}
+				break;
+			case 'e':
+				bopts.rng_seed = std::stoul(optarg);
+				break;
+			case 'c':
+				bopts.seed_count = std::stoul(optarg);
+				break;
+			case 't':
+				if (!parse_point_format(optarg, bopts.format)) {
+					std::cerr << "Unknown output format: " << optarg << std::endl;
+					return false;
+				}
+				break;
+			case 'O':
+				bopts.output_file = optarg;
+				break;
+			case 'j':
+				bopts.threads = std::stoul(optarg);
+				break;
+			case 'T': {
+				auto tiles = std::stoul(optarg);
+
+				if (tiles < 2 || tiles % 2 != 0 || tiles > MAX_TILES) {
+					std::cerr << "Tile count should be even, >= 2 and <= " << MAX_TILES << std::endl;
+					return false;
+				}
+
+				bopts.tiles = (uint32_t)tiles;
+				break;
+			}
+			case 'g':
+				if (!parse_engine(optarg, bopts.engine)) {
+					std::cerr << "Unknown engine: " << optarg << std::endl;
+					return false;
+				}
+				break;
+			case 'u':
+				if (!parse_queue(optarg, bopts.queue)) {
+					std::cerr << "Unknown queue: " << optarg << std::endl;
+					return false;
+				}
+				break;
+			case '?':
+				return false;
+			}
+		} catch (...) {
+			std::cerr << "Failed to parse " << argv[optind - 1] << std::endl;
+			return false;
+		}
+	}
+
+	if (optind < argc) {
+		bopts.results_file = argv[optind];
+	}
+
+	if (bopts.min_count < bopts.seed_count || bopts.min_count > bopts.max_count) {
+		std::cerr << "Bad point count range" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	bench_options bopts;
+
+	if (!parse_options(argc, argv, bopts)) {
+		return 1;
+	}
+
+	std::vector<bench_result> results;
+
+	fprintf(stderr, "%10s %12s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n",
+		"points", "points/s", "total", "scan", "fill", "insert",
+		"enqueue", "pop", "remove", "output", "rss (MB)");
+
+	for (uint64_t n = bopts.min_count; n <= bopts.max_count; n *= 4) {
+		auto r = run(bopts, n);
+		const auto &s = r.stats;
+
+		fprintf(stderr, "%10u %12.0f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.1f\n",
+			r.point_count, r.points_per_second, s.total, s.nine_sheet_scan,
+			s.bulk_fill, s.insert, s.enqueue, s.pop, s.remove, s.output,
+			s.peak_rss / (1024.0 * 1024.0));
+
+		// How far off the tiled engine is, as a percentage of the exact set
+		for (const auto &q : r.quality) {
+			fprintf(stderr, "%10s %10u points: min distance %+.3f%%, covering radius %+.3f%%\n",
+				"vs exact", q.point_count,
+				100.0 * (q.tiled.min_distance / q.exact.min_distance - 1),
+				100.0 * (q.tiled.covering_radius / q.exact.covering_radius - 1));
+		}
+
+		results.push_back(r);
+
+		// Write after every run, so that you get something even if you get
+		// bored and kill it during the 16M run.
+		write_results(bopts, results);
+	}
+
+	return 0;
+}
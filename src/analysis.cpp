@@ -0,0 +1,497 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Blue noise quality measures. Everybody judges point sets by their power
+ * spectrum, so it's nice to be able to get one without piping the points
+ * through a Python script.
+ *
+ * The spectrum of points x_j is P(k) = |sum_j exp(-2 pi i k . x_j)|^2 / N for
+ * integer frequencies k (the set is periodic, so those are the only ones that
+ * make sense). Doing that sum directly is N work per frequency, so instead the
+ * points are splatted onto a grid (cloud-in-cell, i.e. bilinear weights on the
+ * four closest grid nodes) and the grid goes through an FFT. The splatting
+ * blurs the points a little, which multiplies the spectrum by sinc^4 in each
+ * direction, so that gets divided out again. What can't be divided out is the
+ * aliasing from frequencies above the grid's Nyquist frequency, which is why
+ * only frequencies up to a quarter of the grid size are kept, where it's too
+ * small to matter.
+ *
+ * The FFT is a plain radix-2 one: all the rows in parallel, transpose, all the
+ * rows again. It's not FFTW, but it doesn't have to be, a 4096^2 grid is done
+ * in a second or two. It does want 16 bytes per grid node, though, so that one
+ * takes 256 MiB.
+ *
+ * Nearest neighbors are found with point_grid::nearest (the same query the rank
+ * maps use), leaving out the point itself. The grid only keeps floats, so the
+ * distance to the neighbor it finds is worked out again from the doubles.
+ *
+ * Everything that's summed up is summed in a fixed number of chunks, which are
+ * then added together in order, so the numbers don't change with the number of
+ * threads.
+ */
+
+#include "analysis.hpp"
+#include "point_grid.hpp"
+#include "worker_pool.hpp"
+
+#include <cairo.h>
+#include <complex>
+#include <png.h>
+
+// Number of chunks that sums are split into (see above)
+static const size_t CHUNKS = 64;
+
+typedef std::complex<double> complex;
+
+uint32_t default_spectrum_grid(size_t point_count)
+{
+	double wanted = 8.0 * std::sqrt((double)point_count);
+	uint32_t grid = 64;
+
+	while (grid < wanted && grid < 4096) grid *= 2;
+
+	return grid;
+}
+
+/**
+ * In place FFT of n values (n a power of two). twiddles[k] is
+ * exp(-2 pi i k / n), for k < n/2.
+ */
+static void fft(complex *data, size_t n, const std::vector<complex> &twiddles)
+{
+	// Bit reversed order
+	for (size_t i = 1, j = 0; i < n; i++) {
+		size_t bit = n >> 1;
+
+		for (; j & bit; bit >>= 1) j ^= bit;
+
+		j ^= bit;
+
+		if (i < j) std::swap(data[i], data[j]);
+	}
+
+	for (size_t len = 2; len <= n; len *= 2) {
+		size_t half = len / 2;
+		size_t step = n / len;
+
+		for (size_t i = 0; i < n; i += len) {
+			for (size_t k = 0; k < half; k++) {
+				// Multiplied out by hand, since operator* on std::complex
+				// checks for infinities and NaNs.
+				auto w = twiddles[k * step];
+				auto a = data[i + k];
+				auto b = data[i + k + half];
+				complex wb {
+					w.real() * b.real() - w.imag() * b.imag(),
+					w.real() * b.imag() + w.imag() * b.real() };
+
+				data[i + k] = a + wb;
+				data[i + k + half] = a - wb;
+			}
+		}
+	}
+}
+
+/**
+ * The power that cloud-in-cell splatting leaves of frequency k on a grid of
+ * size n, in one direction.
+ */
+static double cic_window(int32_t k, uint32_t n)
+{
+	if (k == 0) return 1.0;
+
+	double x = M_PI * k / n;
+	double s = std::sin(x) / x;
+
+	return s * s * s * s;
+}
+
+point_spectrum compute_spectrum(const std::vector<vec2> &points, uint32_t grid, uint32_t threads)
+{
+	assert(grid >= 4 && (grid & (grid - 1)) == 0);
+
+	size_t n = grid;
+	std::vector<complex> data(n * n);
+
+	for (auto &p : points) {
+		double u = p.x * n;
+		double v = p.y * n;
+		double fx = u - std::floor(u);
+		double fy = v - std::floor(v);
+
+		size_t x0 = (size_t)(int64_t)std::floor(u) & (n - 1);
+		size_t y0 = (size_t)(int64_t)std::floor(v) & (n - 1);
+		size_t x1 = (x0 + 1) & (n - 1);
+		size_t y1 = (y0 + 1) & (n - 1);
+
+		data[y0 * n + x0] += (1 - fx) * (1 - fy);
+		data[y0 * n + x1] += fx * (1 - fy);
+		data[y1 * n + x0] += (1 - fx) * fy;
+		data[y1 * n + x1] += fx * fy;
+	}
+
+	std::vector<complex> twiddles(n / 2);
+
+	for (size_t k = 0; k < n / 2; k++) {
+		double angle = -TAU * k / n;
+		twiddles[k] = complex { std::cos(angle), std::sin(angle) };
+	}
+
+	worker_pool pool { threads };
+
+	// Rows (x), then columns (y) by way of a transpose. Afterwards the
+	// frequency (kx, ky) is at data[kx * n + ky].
+	pool.parallel_for(n, [&](size_t y) {
+		fft(&data[y * n], n, twiddles);
+	});
+
+	pool.parallel_for(n, [&](size_t i) {
+		for (size_t j = i + 1; j < n; j++) {
+			std::swap(data[i * n + j], data[j * n + i]);
+		}
+	});
+
+	pool.parallel_for(n, [&](size_t x) {
+		fft(&data[x * n], n, twiddles);
+	});
+
+	point_spectrum spectrum;
+
+	spectrum.grid = grid;
+	spectrum.max_frequency = grid / 4;
+	spectrum.point_count = (uint32_t)points.size();
+
+	int32_t max_f = (int32_t)spectrum.max_frequency;
+	size_t side = spectrum.side();
+	size_t rings = spectrum.max_frequency + 1;
+
+	std::vector<double> window(side);
+
+	for (int32_t k = -max_f; k < max_f; k++) {
+		window[k + max_f] = cic_window(k, grid);
+	}
+
+	spectrum.power.resize(side * side);
+
+	struct ring_sums {
+		std::vector<double> sum, sum2;
+		std::vector<uint64_t> count;
+	};
+
+	std::vector<ring_sums> chunks(CHUNKS);
+	double scale = points.empty() ? 0.0 : 1.0 / points.size();
+
+	pool.parallel_for(CHUNKS, [&](size_t c) {
+		auto &sums = chunks[c];
+
+		sums.sum.assign(rings, 0.0);
+		sums.sum2.assign(rings, 0.0);
+		sums.count.assign(rings, 0);
+
+		for (size_t row = c * side / CHUNKS; row < (c + 1) * side / CHUNKS; row++) {
+			int32_t ky = (int32_t)row - max_f;
+
+			for (int32_t kx = -max_f; kx < max_f; kx++) {
+				auto &g = data[((size_t)kx & (n - 1)) * n + ((size_t)ky & (n - 1))];
+				double power = std::norm(g) * scale / (window[kx + max_f] * window[row]);
+
+				if (kx == 0 && ky == 0) power = 0.0;
+
+				spectrum.power[row * side + (kx + max_f)] = (float)power;
+
+				auto ring = (size_t)std::lround(std::sqrt((double)kx * kx + (double)ky * ky));
+
+				if (ring < rings) {
+					sums.sum[ring] += power;
+					sums.sum2[ring] += power * power;
+					sums.count[ring]++;
+				}
+			}
+		}
+	});
+
+	spectrum.radial_power.assign(rings, 0.0);
+	spectrum.anisotropy.assign(rings, 0.0);
+
+	for (size_t ring = 0; ring < rings; ring++) {
+		double sum = 0.0, sum2 = 0.0;
+		uint64_t count = 0;
+
+		for (auto &sums : chunks) {
+			sum += sums.sum[ring];
+			sum2 += sums.sum2[ring];
+			count += sums.count[ring];
+		}
+
+		if (count == 0) continue;
+
+		double mean = sum / count;
+		double variance = sum2 / count - mean * mean;
+
+		spectrum.radial_power[ring] = mean;
+
+		if (mean > 0.0 && variance > 0.0) {
+			spectrum.anisotropy[ring] = 10.0 * std::log10(variance / (mean * mean));
+		}
+	}
+
+	return spectrum;
+}
+
+neighbor_stats nearest_neighbors(const std::vector<vec2> &points, uint32_t threads)
+{
+	neighbor_stats stats { 0.0, 0.0, 0.0, 0.0 };
+	size_t n = points.size();
+
+	if (n < 2) return stats;
+
+	point_grid grid { points };
+
+	struct partial {
+		double min = std::numeric_limits<double>::infinity();
+		double max = 0.0;
+		double sum = 0.0;
+		double sum2 = 0.0;
+	};
+
+	std::vector<partial> partials(CHUNKS);
+	worker_pool pool { threads };
+
+	pool.parallel_for(CHUNKS, [&](size_t c) {
+		auto &part = partials[c];
+
+		for (size_t k = c * n / CHUNKS; k < (c + 1) * n / CHUNKS; k++) {
+			auto p = points[k];
+			auto q = points[grid.nearest(p.x, p.y, (uint32_t)k)];
+
+			double dx = q.x - p.x;
+			double dy = q.y - p.y;
+
+			dx -= std::round(dx);
+			dy -= std::round(dy);
+
+			double d = std::sqrt(dx * dx + dy * dy);
+
+			part.min = std::min(part.min, d);
+			part.max = std::max(part.max, d);
+			part.sum += d;
+			part.sum2 += d * d;
+		}
+	});
+
+	stats.min = std::numeric_limits<double>::infinity();
+
+	double sum = 0.0, sum2 = 0.0;
+
+	for (auto &part : partials) {
+		stats.min = std::min(stats.min, part.min);
+		stats.max = std::max(stats.max, part.max);
+		sum += part.sum;
+		sum2 += part.sum2;
+	}
+
+	stats.mean = sum / n;
+	stats.stddev = std::sqrt(std::max(0.0, sum2 / n - stats.mean * stats.mean));
+
+	return stats;
+}
+
+double hex_spacing(size_t point_count)
+{
+	return std::sqrt(2.0 / (std::sqrt(3.0) * point_count));
+}
+
+double hex_frequency(size_t point_count)
+{
+	return std::sqrt(2.0 * point_count / std::sqrt(3.0));
+}
+
+bool save_spectrum_png(const std::string &file, const point_spectrum &spectrum, double max_power)
+{
+	FILE *fp = fopen(file.c_str(), "wb");
+
+	if (!fp) {
+		std::cerr << "Failed to open " << file << std::endl;
+		return false;
+	}
+
+	auto png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	auto info = png ? png_create_info_struct(png) : nullptr;
+
+	if (!info) {
+		std::cerr << "Failed to set up libpng" << std::endl;
+		png_destroy_write_struct(&png, nullptr);
+		fclose(fp);
+		return false;
+	}
+
+	uint32_t side = spectrum.side();
+	std::vector<png_byte> row(side);
+
+	if (setjmp(png_jmpbuf(png))) {
+		std::cerr << "Failed to write " << file << std::endl;
+		png_destroy_write_struct(&png, &info);
+		fclose(fp);
+		return false;
+	}
+
+	png_init_io(png, fp);
+	png_set_IHDR(png, info, side, side, 8,
+		PNG_COLOR_TYPE_GRAY,
+		PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	// Positive ky up, like every plot of a spectrum ever
+	for (uint32_t y = 0; y < side; y++) {
+		auto src = &spectrum.power[(size_t)(side - 1 - y) * side];
+
+		for (uint32_t x = 0; x < side; x++) {
+			double value = std::clamp(src[x] / max_power, 0.0, 1.0);
+			row[x] = (png_byte)std::lround(255.0 * value);
+		}
+
+		png_write_row(png, row.data());
+	}
+
+	png_write_end(png, nullptr);
+	png_destroy_write_struct(&png, &info);
+
+	return fclose(fp) == 0;
+}
+
+/**
+ * Draw one curve of the radial plot, values[f] for f from 1 up, mapped from
+ * [lo, hi] to the panel at (x0, y0) of size w x h. Values outside are clamped
+ * to the edge.
+ */
+static void plot_curve(
+	cairo_t *cr,
+	const std::vector<double> &values,
+	double lo, double hi,
+	double x0, double y0, double w, double h)
+{
+	auto count = values.size();
+
+	cairo_new_path(cr);
+
+	for (size_t f = 1; f < count; f++) {
+		double t = std::clamp((values[f] - lo) / (hi - lo), 0.0, 1.0);
+		double x = x0 + w * f / (count - 1);
+		double y = y0 + h * (1.0 - t);
+
+		if (f == 1) {
+			cairo_move_to(cr, x, y);
+		} else {
+			cairo_line_to(cr, x, y);
+		}
+	}
+
+	cairo_stroke(cr);
+}
+
+/**
+ * A straight line from (x0, y0) to (x1, y1).
+ */
+static void plot_line(cairo_t *cr, double x0, double y0, double x1, double y1)
+{
+	cairo_new_path(cr);
+	cairo_move_to(cr, x0, y0);
+	cairo_line_to(cr, x1, y1);
+	cairo_stroke(cr);
+}
+
+bool save_radial_png(
+	const std::string &file,
+	const point_spectrum &spectrum,
+	uint32_t width,
+	uint32_t height)
+{
+	// The power goes in the top two thirds, on a scale from 0 to a bit above
+	// the peak (at least 2). The anisotropy goes in the bottom third, from
+	// -20 dB to 10 dB.
+	const double margin = 16.0;
+	const double min_db = -20.0;
+	const double max_db = 10.0;
+
+	if (spectrum.radial_power.size() < 3) {
+		std::cerr << "The spectrum is too small to plot" << std::endl;
+		return false;
+	}
+
+	auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	auto cr = cairo_create(surface);
+
+	double w = width - 2 * margin;
+	double h = height - 3 * margin;
+	double power_h = h * 2.0 / 3.0;
+	double aniso_h = h - power_h;
+	double aniso_y = 2 * margin + power_h;
+
+	double peak = *std::max_element(spectrum.radial_power.begin() + 1, spectrum.radial_power.end());
+	double max_power = std::max(2.0, 1.1 * peak);
+
+	cairo_set_source_rgba(cr, 1, 1, 1, 1);
+	cairo_paint(cr);
+
+	cairo_set_line_width(cr, 1.0);
+	cairo_set_source_rgba(cr, 0.6, 0.6, 0.6, 1);
+	cairo_rectangle(cr, margin, margin, w, power_h);
+	cairo_rectangle(cr, margin, aniso_y, w, aniso_h);
+	cairo_stroke(cr);
+
+	// White noise: power 1 and 0 dB
+	double white_y = margin + power_h * (1.0 - 1.0 / max_power);
+	double zero_db_y = aniso_y + aniso_h * (max_db / (max_db - min_db));
+
+	plot_line(cr, margin, white_y, margin + w, white_y);
+	plot_line(cr, margin, zero_db_y, margin + w, zero_db_y);
+
+	// The hex lattice frequency, if it's on the plot
+	double hex = hex_frequency(spectrum.point_count);
+
+	if (hex < spectrum.max_frequency) {
+		double x = margin + w * hex / spectrum.max_frequency;
+
+		cairo_set_source_rgba(cr, 0.2, 0.4, 0.9, 1);
+		plot_line(cr, x, margin, x, aniso_y + aniso_h);
+	}
+
+	cairo_set_line_width(cr, 1.5);
+
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	plot_curve(cr, spectrum.radial_power, 0.0, max_power, margin, margin, w, power_h);
+
+	cairo_set_source_rgba(cr, 0.8, 0.1, 0.1, 1);
+	plot_curve(cr, spectrum.anisotropy, min_db, max_db, margin, aniso_y, w, aniso_h);
+
+	cairo_destroy(cr);
+
+	auto status = cairo_surface_write_to_png(surface, file.c_str());
+	cairo_surface_destroy(surface);
+
+	if (status != CAIRO_STATUS_SUCCESS) {
+		std::cerr << "Failed to save " << file << ": " << cairo_status_to_string(status) << std::endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Blue noise quality measures for a point set: the power spectrum (and the
+ * radial averages everybody plots) and nearest neighbor distances. See
+ * analysis.cpp.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+/**
+ * The power spectrum (periodogram) of a point set on the torus.
+ *
+ * Frequencies are integer (kx, ky), and it's normalized so that white noise
+ * has an expected power of 1 everywhere. The zero frequency (which is just the
+ * number of points) is set to 0.
+ */
+struct point_spectrum {
+	// Size of the FFT grid. Only frequencies up to max_frequency (= grid / 4)
+	// in each direction are accurate, so that's all that's kept.
+	uint32_t grid;
+	uint32_t max_frequency;
+	uint32_t point_count;
+
+	// The power for kx, ky in [-max_frequency, max_frequency), row by row
+	// (ky outer), so zero is in the middle at (max_frequency, max_frequency).
+	std::vector<float> power;
+
+	// For every ring of frequencies |k| in [f - 0.5, f + 0.5), f from 0 to
+	// max_frequency: the mean power, and the anisotropy in dB, i.e.
+	// 10 log10(variance / mean^2). White noise has 0 dB.
+	std::vector<double> radial_power;
+	std::vector<double> anisotropy;
+
+	uint32_t side() const { return 2 * max_frequency; }
+
+	float at(int32_t kx, int32_t ky) const
+	{
+		return power[(size_t)(ky + max_frequency) * side() + (kx + max_frequency)];
+	}
+};
+
+/**
+ * The FFT grid size compute_spectrum uses for a point count if it isn't told:
+ * big enough to see a bit past the peak of a well spread out set, at most 4096.
+ */
+uint32_t default_spectrum_grid(size_t point_count);
+
+/**
+ * Compute the spectrum of some points in [0,1)x[0,1). grid has to be a power
+ * of two. threads is the number of threads to use, 0 for one per hardware
+ * thread. The result doesn't depend on the number of threads.
+ */
+point_spectrum compute_spectrum(const std::vector<vec2> &points, uint32_t grid, uint32_t threads = 0);
+
+/**
+ * Distance from every point to its closest neighbor (on the torus), summed up.
+ */
+struct neighbor_stats {
+	double min;
+	double mean;
+	double max;
+	double stddev;
+};
+
+neighbor_stats nearest_neighbors(const std::vector<vec2> &points, uint32_t threads = 0);
+
+/**
+ * The spacing of a hexagonal lattice with this many points in the unit square,
+ * the best you can do for the nearest neighbor distance. Its spectrum has its
+ * first peak at frequency hex_frequency.
+ */
+double hex_spacing(size_t point_count);
+double hex_frequency(size_t point_count);
+
+/**
+ * Save the spectrum as an 8-bit grayscale PNG, zero frequency in the middle.
+ * Power 0 is black and max_power (or more) is white. Returns false, and
+ * complains on stderr, if it couldn't be saved.
+ */
+bool save_spectrum_png(const std::string &file, const point_spectrum &spectrum, double max_power = 4.0);
+
+/**
+ * Plot the radially averaged power (black) and anisotropy (red), against the
+ * frequency, into a width x height PNG. There's a gray line at the power of
+ * white noise, and a blue one at the hex lattice frequency.
+ */
+bool save_radial_png(
+	const std::string &file,
+	const point_spectrum &spectrum,
+	uint32_t width = 1024,
+	uint32_t height = 512);
@@ -0,0 +1,340 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The `ivs analyze` subcommand: how blue is this noise?
+ */
+
+#include "main.hpp"
+#include "analysis.hpp"
+
+#include <getopt.h>
+
+static void print_analyze_help()
+{
+    std::cout << R"HELP(Incremental voronoi set analyzer
+
+Usage: ivs analyze [options] <points>
+
+Measures the set in <points> (a point file written by ivs, in any format, or
+"-" for stdin): its power spectrum, the radial average and anisotropy of it,
+and the distances between nearest neighbors. Prints a report as JSON. Since an
+IVS is good at every size, --count can pick out the first k points of it.
+
+The spectrum is normalized so that white noise has power 1, and is accurate up
+to a quarter of the grid size. Distances are also given relative to the
+spacing of a hexagonal lattice with the same number of points, and frequencies
+relative to that lattice's first peak.
+
+Options:
+    -h, --help                  Print this help text
+
+    -n, --count <k>             Only use the first k points
+    -g, --grid <n>              Size of the FFT grid, a power of two (default
+                                is about 8 times the square root of the number
+                                of points, at most 4096)
+    -s, --spectrum <file>       Save the spectrum as a grayscale PNG, zero
+                                frequency in the middle, power 4 and up white
+    -r, --radial <file>         Save a plot of the radial power (top) and
+                                anisotropy (bottom) as a PNG
+    -o, --output <file>         Write the report to <file> instead of stdout
+    -j, --threads <n>           Number of threads (default 0 = one per core)
+)HELP";
+}
+
+/**
+ * The summary numbers of a spectrum.
+ */
+struct spectrum_summary {
+    // The highest ring
+    uint32_t peak_frequency;
+    double peak_power;
+
+    // The first frequency where the radial power reaches 0.1, i.e. where the
+    // "blue" part of the spectrum ends
+    uint32_t effective_nyquist;
+
+    // Mean anisotropy from the effective Nyquist frequency up
+    double anisotropy;
+
+    // The biggest single frequency. Patterns (like the hexagonal patches
+    // IVSs sometimes get) show up as spikes way above the rest.
+    double spike_power;
+    int32_t spike_kx;
+    int32_t spike_ky;
+};
+
+static spectrum_summary summarize(const point_spectrum &spectrum)
+{
+    spectrum_summary summary { 0, 0.0, 0, 0.0, 0.0, 0, 0 };
+
+    auto &radial = spectrum.radial_power;
+    auto rings = (uint32_t)radial.size();
+
+    for (uint32_t f = 1; f < rings; f++) {
+        if (radial[f] > summary.peak_power) {
+            summary.peak_frequency = f;
+            summary.peak_power = radial[f];
+        }
+    }
+
+    summary.effective_nyquist = rings;
+
+    for (uint32_t f = 1; f < rings; f++) {
+        if (radial[f] >= 0.1) {
+            summary.effective_nyquist = f;
+            break;
+        }
+    }
+
+    double sum = 0.0;
+    uint32_t count = 0;
+
+    for (uint32_t f = summary.effective_nyquist; f < rings; f++) {
+        sum += spectrum.anisotropy[f];
+        count++;
+    }
+
+    summary.anisotropy = count > 0 ? sum / count : 0.0;
+
+    int32_t max_f = (int32_t)spectrum.max_frequency;
+
+    for (int32_t ky = -max_f; ky < max_f; ky++) {
+        for (int32_t kx = -max_f; kx < max_f; kx++) {
+            if (spectrum.at(kx, ky) > summary.spike_power) {
+                summary.spike_power = spectrum.at(kx, ky);
+                summary.spike_kx = kx;
+                summary.spike_ky = ky;
+            }
+        }
+    }
+
+    return summary;
+}
+
+static void write_report(
+    std::ostream &out,
+    const point_spectrum &spectrum,
+    const spectrum_summary &summary,
+    const neighbor_stats &neighbors,
+    double spectrum_seconds,
+    double neighbor_seconds)
+{
+    auto count = spectrum.point_count;
+    double spacing = hex_spacing(count);
+    double hex = hex_frequency(count);
+
+    out.precision(9);
+
+    out << "{\n"
+        << "  \"point_count\": " << count << ",\n"
+        << "  \"grid\": " << spectrum.grid << ",\n"
+        << "  \"max_frequency\": " << spectrum.max_frequency << ",\n"
+        << "  \"hex_spacing\": " << spacing << ",\n"
+        << "  \"hex_frequency\": " << hex << ",\n"
+        << "  \"nearest_neighbor\": {\n"
+        << "    \"min\": " << neighbors.min << ",\n"
+        << "    \"mean\": " << neighbors.mean << ",\n"
+        << "    \"max\": " << neighbors.max << ",\n"
+        << "    \"stddev\": " << neighbors.stddev << ",\n"
+        << "    \"relative_min\": " << neighbors.min / spacing << ",\n"
+        << "    \"relative_mean\": " << neighbors.mean / spacing << "\n"
+        << "  },\n"
+        << "  \"spectrum\": {\n"
+        << "    \"peak_frequency\": " << summary.peak_frequency << ",\n"
+        << "    \"relative_peak_frequency\": " << summary.peak_frequency / hex << ",\n"
+        << "    \"peak_power\": " << summary.peak_power << ",\n"
+        << "    \"effective_nyquist\": " << summary.effective_nyquist << ",\n"
+        << "    \"relative_effective_nyquist\": " << summary.effective_nyquist / hex << ",\n"
+        << "    \"anisotropy_db\": " << summary.anisotropy << ",\n"
+        << "    \"spike\": { \"power\": " << summary.spike_power
+        << ", \"kx\": " << summary.spike_kx
+        << ", \"ky\": " << summary.spike_ky << " }\n"
+        << "  },\n"
+        << "  \"seconds\": {\n"
+        << "    \"spectrum\": " << spectrum_seconds << ",\n"
+        << "    \"nearest_neighbor\": " << neighbor_seconds << "\n"
+        << "  },\n"
+        << "  \"radial\": [\n";
+
+    // One [frequency, power, anisotropy] per ring
+    for (size_t f = 0; f < spectrum.radial_power.size(); f++) {
+        out << "    [" << f << ", " << spectrum.radial_power[f] << ", " << spectrum.anisotropy[f] << "]"
+            << (f + 1 < spectrum.radial_power.size() ? ",\n" : "\n");
+    }
+
+    out << "  ]\n"
+        << "}\n";
+}
+
+int analyze_main(int argc, char **argv)
+{
+    uint32_t count = 0;
+    uint32_t grid = 0;
+    uint32_t threads = 0;
+    std::string spectrum_file = "";
+    std::string radial_file = "";
+    std::string output_file = "";
+
+    static const struct option longopts[]
+    {
+        { "help",     no_argument,       0, 'h' },
+        { "count",    required_argument, 0, 'n' },
+        { "grid",     required_argument, 0, 'g' },
+        { "spectrum", required_argument, 0, 's' },
+        { "radial",   required_argument, 0, 'r' },
+        { "output",   required_argument, 0, 'o' },
+        { "threads",  required_argument, 0, 'j' },
+        { 0, 0, 0, 0 }
+    };
+
+    while (1) {
+        int optindex;
+        int c = getopt_long(argc, argv, "hn:g:s:r:o:j:", longopts, &optindex);
+
+        if (c == -1) break;
+
+        switch (c) {
+        case 'h':
+            print_analyze_help();
+            return 0;
+
+        case 'n':
+            try {
+                count = std::stoul(optarg);
+            } catch (...) {
+                std::cerr << "Failed to parse point count" << std::endl;
+                return 1;
+            }
+
+            if (count == 0) {
+                std::cerr << "The point count has to be at least 1" << std::endl;
+                return 1;
+            }
+            break;
+
+        case 'g':
+            try {
+                grid = std::stoul(optarg);
+            } catch (...) {
+                std::cerr << "Failed to parse grid size" << std::endl;
+                return 1;
+            }
+
+            if (grid < 16 || (grid & (grid - 1)) != 0) {
+                std::cerr << "The grid size has to be a power of two, at least 16" << std::endl;
+                return 1;
+            }
+            break;
+
+        case 's':
+            spectrum_file = optarg;
+            break;
+
+        case 'r':
+            radial_file = optarg;
+            break;
+
+        case 'o':
+            output_file = optarg;
+            break;
+
+        case 'j':
+            try {
+                threads = std::stoul(optarg);
+            } catch (...) {
+                std::cerr << "Failed to parse thread count" << std::endl;
+                return 1;
+            }
+            break;
+
+        case '?':
+            return 1;
+        }
+    }
+
+    if (argc - optind != 1) {
+        std::cerr << "Expected <points>, see ivs analyze --help" << std::endl;
+        return 1;
+    }
+
+    std::vector<vec2> points;
+
+    if (!read_points(argv[optind], points)) {
+        return 1;
+    }
+
+    if (count > 0) {
+        if (count > points.size()) {
+            std::cerr << argv[optind] << " only has " << points.size() << " points" << std::endl;
+            return 1;
+        }
+
+        points.resize(count);
+    }
+
+    if (points.empty()) {
+        std::cerr << argv[optind] << " doesn't have any points" << std::endl;
+        return 1;
+    }
+
+    if (grid == 0) {
+        grid = default_spectrum_grid(points.size());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto spectrum = compute_spectrum(points, grid, threads);
+    auto spectrum_end = std::chrono::steady_clock::now();
+    auto neighbors = nearest_neighbors(points, threads);
+    auto neighbor_end = std::chrono::steady_clock::now();
+
+    auto summary = summarize(spectrum);
+
+    double spectrum_seconds = std::chrono::duration<double>(spectrum_end - start).count();
+    double neighbor_seconds = std::chrono::duration<double>(neighbor_end - spectrum_end).count();
+
+    if (output_file.empty()) {
+        write_report(std::cout, spectrum, summary, neighbors, spectrum_seconds, neighbor_seconds);
+    } else {
+        std::ofstream out { output_file };
+
+        if (!out) {
+            std::cerr << "Failed to open " << output_file << std::endl;
+            return 1;
+        }
+
+        write_report(out, spectrum, summary, neighbors, spectrum_seconds, neighbor_seconds);
+
+        if (!out) {
+            std::cerr << "Failed to write " << output_file << std::endl;
+            return 1;
+        }
+    }
+
+    if (!spectrum_file.empty() && !save_spectrum_png(spectrum_file, spectrum)) {
+        return 1;
+    }
+
+    if (!radial_file.empty() && !save_radial_png(radial_file, spectrum)) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,342 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The `ivs batch` subcommand: generate a whole bunch of sets in one go.
+ *
+ * Every job gets its own triangulation and queue, so they run completely
+ * independently on a worker_pool, one job per thread at a time. The jobs are
+ * handed out biggest first, so that a big job doesn't get started last and
+ * leave everyone else waiting for it. Each thread has its own ivs_workspace,
+ * so the queues and buffers only get allocated once per thread, no matter how
+ * many jobs it runs.
+ */
+
+#include "main.hpp"
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <getopt.h>
+#include <mutex>
+#include <numeric>
+#include <unordered_map>
+
+struct batch_options {
+    point_format format;
+    ivs_engine engine;
+    ivs_queue queue;
+    uint32_t threads;
+
+    batch_options()
+        : format { point_format::text }
+        , engine { ivs_engine::cgal }
+        , queue { ivs_queue::heap }
+        , threads { 0 }
+    {
+    }
+};
+
+/**
+ * One line of the job file.
+ */
+struct batch_job {
+    uint32_t rng_seed;
+    uint32_t seed_count;
+    uint32_t point_count;
+    std::string output;
+};
+
+static void print_batch_help()
+{
+    std::cout << R"HELP(Incremental voronoi set batch generator
+
+Usage: ivs batch [options] <jobs>
+
+Generates every set listed in <jobs> (a file, or "-" for stdin), in parallel.
+Each line of <jobs> is one set:
+
+    <seed> <seed-count> <number> <output-file>
+
+which generates the same set as
+
+    ivs --seed <seed> --seed-count <seed-count> -n <number> <output-file>
+
+Empty lines and lines starting with # are skipped. No two lines can have the
+same <output-file>.
+
+Options:
+    -h, --help                  Print this help text
+
+        --format <fmt>          Format of the output files (text, binary or
+                                binary32, default text)
+        --engine <engine>       Triangulation to use (cgal or compact,
+                                default cgal, the tiled engine isn't
+                                supported)
+        --queue <queue>         Priority queue to use (heap or bucket,
+                                default heap)
+    -j, --threads <n>           Number of jobs to run at once (default 0 = one
+                                per core)
+)HELP";
+}
+
+static bool read_jobs(const char *file, std::vector<batch_job> &jobs)
+{
+    std::ifstream in;
+
+    if (strcmp(file, "-") != 0) {
+        in.open(file);
+
+        if (!in) {
+            std::cerr << "Failed to open " << file << std::endl;
+            return false;
+        }
+    }
+
+    std::istream &input = in.is_open() ? in : std::cin;
+    std::string line;
+    int line_number = 0;
+
+    // Line each output file was first seen on. Two jobs writing the same file
+    // at once would just make a mess of it.
+    std::unordered_map<std::string, int> output_lines;
+
+    while (std::getline(input, line)) {
+        line_number++;
+
+        auto first = line.find_first_not_of(" \t\r");
+
+        if (first == std::string::npos || line[first] == '#') continue;
+
+        std::istringstream fields { line };
+        batch_job job;
+        std::string rest;
+
+        if (!(fields >> job.rng_seed >> job.seed_count >> job.point_count >> job.output) || (fields >> rest)) {
+            std::cerr << file << ":" << line_number
+                << ": expected <seed> <seed-count> <number> <output-file>" << std::endl;
+            return false;
+        }
+
+        if (job.seed_count < 2 || job.point_count < job.seed_count) {
+            std::cerr << file << ":" << line_number
+                << ": seed count should be >= 2, and the number of points at least the seed count" << std::endl;
+            return false;
+        }
+
+        if (job.point_count > MAX_POINT_COUNT) {
+            std::cerr << file << ":" << line_number
+                << ": at most " << MAX_POINT_COUNT << " points per set" << std::endl;
+            return false;
+        }
+
+        auto seen = output_lines.emplace(job.output, line_number);
+
+        if (!seen.second) {
+            std::cerr << file << ":" << line_number << ": " << job.output
+                << " is already the output of line " << seen.first->second << std::endl;
+            return false;
+        }
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+/**
+ * Generate one set and write it out. On failure, error says what happened.
+ */
+static bool run_job(
+    const batch_job &job,
+    const batch_options &bopts,
+    ivs_workspace &workspace,
+    std::string &error)
+{
+    std::ofstream out { job.output, std::ios::out | std::ios::binary };
+
+    if (!out) {
+        error = "failed to open the output file";
+        return false;
+    }
+
+    point_file_header header { job.point_count, job.rng_seed, job.seed_count };
+    auto writer = make_point_writer(bopts.format, out, header);
+
+    ivs_config config;
+
+    config.point_count = job.point_count;
+    config.seeds       = make_seeds(job.rng_seed, job.seed_count);
+    config.engine      = bopts.engine;
+    config.queue       = bopts.queue;
+    config.threads     = 1;
+    config.workspace   = &workspace;
+
+    try {
+        generate_ivs(config, [&](uint32_t, vec2 point) { writer->write(point); });
+        writer->flush();
+    } catch (...) {
+        error = "failed to generate the set";
+        return false;
+    }
+
+    if (!out) {
+        error = "failed to write the output file";
+        return false;
+    }
+
+    return true;
+}
+
+int batch_main(int argc, char **argv)
+{
+    batch_options bopts;
+    int help = false;
+
+    static const struct option longopts[]
+    {
+        { "help",    no_argument,       &help, 1 },
+        { "format",  required_argument, 0, 't' },
+        { "engine",  required_argument, 0, 'g' },
+        { "queue",   required_argument, 0, 'u' },
+        { "threads", required_argument, 0, 'j' },
+        { 0, 0, 0, 0 }
+    };
+
+    while (1) {
+        int optindex;
+        int c = getopt_long(argc, argv, "hj:", longopts, &optindex);
+
+        if (c == -1) break;
+
+        switch (c) {
+        case 'h':
+            help = true;
+            break;
+        case 't':
+            if (!parse_point_format(optarg, bopts.format)) {
+                std::cerr << "Unknown output format: " << optarg << std::endl;
+                return 1;
+            }
+            break;
+        case 'g':
+            if (!parse_engine(optarg, bopts.engine)) {
+                std::cerr << "Unknown engine: " << optarg << std::endl;
+                return 1;
+            }
+
+            // The tiled engine is for one huge set on lots of threads, and
+            // its sets aren't the ones ivs would make with the same seed
+            if (bopts.engine == ivs_engine::tiled) {
+                std::cerr << "The tiled engine can't be used in batches" << std::endl;
+                return 1;
+            }
+            break;
+        case 'u':
+            if (!parse_queue(optarg, bopts.queue)) {
+                std::cerr << "Unknown queue: " << optarg << std::endl;
+                return 1;
+            }
+            break;
+        case 'j':
+            try {
+                bopts.threads = std::stoul(optarg);
+            } catch (...) {
+                std::cerr << "Failed to parse thread count" << std::endl;
+                return 1;
+            }
+            break;
+        case '?':
+            return 1;
+        }
+    }
+
+    if (help) {
+        print_batch_help();
+        return 0;
+    }
+
+    if (argc - optind != 1) {
+        std::cerr << "Expected <jobs>, see ivs batch --help" << std::endl;
+        return 1;
+    }
+
+    std::vector<batch_job> jobs;
+
+    if (!read_jobs(argv[optind], jobs)) {
+        return 1;
+    }
+
+    // Biggest first
+    std::vector<size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return jobs[a].point_count > jobs[b].point_count;
+    });
+
+    worker_pool pool { bopts.threads };
+
+    std::mutex log_mutex;
+    size_t finished = 0;
+    size_t failed = 0;
+    uint64_t total_points = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    pool.parallel_for(order.size(), [&](size_t k) {
+        const auto &job = jobs[order[k]];
+
+        // One per thread, kept around for every job the thread runs
+        thread_local ivs_workspace workspace;
+
+        auto job_start = std::chrono::steady_clock::now();
+        std::string error;
+        bool ok = run_job(job, bopts, workspace, error);
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job_start).count();
+
+        std::lock_guard<std::mutex> lock { log_mutex };
+
+        finished++;
+
+        if (ok) {
+            total_points += job.point_count;
+
+            fprintf(stderr, "[%zu/%zu] %s: %u points in %.2f s\n",
+                finished, jobs.size(), job.output.c_str(), job.point_count, seconds);
+        } else {
+            failed++;
+
+            fprintf(stderr, "[%zu/%zu] %s: %s\n",
+                finished, jobs.size(), job.output.c_str(), error.c_str());
+        }
+    });
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    fprintf(stderr, "Generated %zu sets (%llu points) on %u threads in %.2f s, %.0f points/s\n",
+        jobs.size() - failed, (unsigned long long)total_points, pool.size(), seconds,
+        seconds > 0 ? total_points / seconds : 0.0);
+
+    if (failed > 0) {
+        fprintf(stderr, "%zu jobs failed\n", failed);
+        return 1;
+    }
+
+    return 0;
+}
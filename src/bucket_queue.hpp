@@ -0,0 +1,290 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * A bucket queue for the faces of the triangulation, for when the 4-ary heap in
+ * face_queue.hpp starts to hurt.
+ *
+ * The thing about an IVS is that the largest circle only ever gets (a little
+ * bit) smaller, and the faces a new point creates are always smaller than the
+ * one it was the center of. So most of what's pushed onto the queue won't be
+ * looked at for a long time, and keeping all of it sorted in one big heap is a
+ * waste: every push and every remove has to walk a heap of millions of
+ * entries, which is mostly cache misses.
+ *
+ * So the entries are sorted into buckets on their squared radius, 16 buckets
+ * per power of two (the bucket is just the top bits of the double, exponent
+ * and 4 bits of mantissa, which sorts the same way as the doubles do). Only
+ * the "front", everything from the current top bucket and up, is kept in an
+ * actual heap (a face_heap). Everything below it is parked in its bucket in
+ * no particular order, which makes pushing and removing O(1). When the front
+ * runs dry, the next non-empty bucket is moved into it.
+ *
+ * Since the buckets never overlap and the front is a regular heap with the same
+ * ordering, things come out in exactly the same order as with face_heap, ties
+ * and all, so the points are the same.
+ *
+ * Faces in the front have their heap position as their slot, the same as in a
+ * face_heap. Parked faces have their position in the parking lot with the top
+ * bit set, which is way past the end of the front, so as far as the front is
+ * concerned, they're not in it.
+ */
+
+#pragma once
+
+#include "face_queue.hpp"
+
+#include <cstring>
+
+template <typename Entry, typename Faces>
+class bucket_queue
+{
+public:
+	/**
+	 * Slot value for faces that aren't in the queue.
+	 */
+	static constexpr uint32_t NOT_QUEUED = std::numeric_limits<uint32_t>::max();
+
+	explicit bucket_queue(Faces faces = Faces {})
+		: faces { faces }
+		, front { faces }
+		, front_bucket { 0 }
+		, buckets(BUCKET_COUNT)
+		, parked_count { 0 }
+	{
+	}
+
+	bool empty() const { return front.empty(); }
+	size_t size() const { return front.size() + parked_count; }
+
+	/**
+	 * The largest entry in the queue. There's never anything parked while the
+	 * front is empty, so it's always in the front.
+	 */
+	const Entry &top() const
+	{
+		return front.top();
+	}
+
+	void push(const Entry &entry)
+	{
+		auto bucket = bucket_of(entry.r2);
+
+		if (front.empty()) {
+			front_bucket = bucket;
+		}
+
+		if (bucket >= front_bucket) {
+			front.push(entry);
+		} else {
+			park(entry, bucket);
+		}
+	}
+
+	/**
+	 * Remove and return the largest entry in the queue.
+	 */
+	Entry pop()
+	{
+		Entry top = front.pop();
+
+		if (front.empty()) refill();
+
+		return top;
+	}
+
+	/**
+	 * Is this face in the queue?
+	 */
+	template <typename Face>
+	bool contains(const Face &face) const
+	{
+		return front.contains(face) || is_parked(face);
+	}
+
+	/**
+	 * Remove the entry for a face from the queue. Does nothing if the face
+	 * isn't in it.
+	 */
+	template <typename Face>
+	void remove(const Face &face)
+	{
+		if (front.contains(face)) {
+			front.remove(face);
+
+			if (front.empty()) refill();
+		} else if (is_parked(face)) {
+			unpark(faces.slot(face) & ~PARKED);
+			faces.slot(face) = NOT_QUEUED;
+		}
+	}
+
+	/**
+	 * Make room for n entries.
+	 */
+	void reserve(size_t n)
+	{
+		lot.reserve(n);
+	}
+
+	/**
+	 * Empty the queue. Like with face_heap, the slots in the faces are left as
+	 * they are, since the stamps won't match anything any more.
+	 */
+	void clear()
+	{
+		front.clear();
+
+		for (auto &bucket : buckets) {
+			bucket.clear();
+		}
+
+		lot.clear();
+		free_spots.clear();
+		parked_count = 0;
+	}
+
+private:
+	// 4 bits of mantissa, so 16 buckets per power of two
+	static constexpr uint32_t MANTISSA_BITS = 4;
+	static constexpr uint32_t BUCKET_COUNT = 2048 << MANTISSA_BITS;
+
+	static constexpr uint32_t PARKED = 1u << 31;
+
+	/**
+	 * An entry that's parked in a bucket, and where in the bucket it is.
+	 */
+	struct parked_entry {
+		Entry entry;
+		uint32_t bucket;
+		uint32_t index;
+	};
+
+	Faces faces;
+	face_heap<Entry, Faces> front;
+
+	// Everything in a bucket at or above this one is in the front, everything
+	// below is parked
+	uint32_t front_bucket;
+
+	// The parked entries. A bucket is a list of spots in the lot, and spots
+	// that have been vacated are reused.
+	std::vector<parked_entry> lot;
+	std::vector<uint32_t> free_spots;
+	std::vector<std::vector<uint32_t>> buckets;
+	size_t parked_count;
+
+	/**
+	 * Bucket of a squared radius. For positive doubles, the bits sort the
+	 * same way as the numbers, so the top bits do too.
+	 */
+	static uint32_t bucket_of(double r2)
+	{
+		assert(r2 > 0);
+
+		uint64_t bits;
+		std::memcpy(&bits, &r2, sizeof(bits));
+
+		return (uint32_t)(bits >> (52 - MANTISSA_BITS));
+	}
+
+	template <typename Face>
+	bool is_parked(const Face &face) const
+	{
+		auto slot = faces.slot(face);
+
+		if (slot == NOT_QUEUED || (slot & PARKED) == 0) return false;
+
+		slot &= ~PARKED;
+
+		return slot < lot.size() && lot[slot].entry.stamp == faces.stamp(face);
+	}
+
+	void park(const Entry &entry, uint32_t bucket)
+	{
+		uint32_t spot;
+
+		if (free_spots.empty()) {
+			spot = (uint32_t)lot.size();
+			lot.emplace_back();
+		} else {
+			spot = free_spots.back();
+			free_spots.pop_back();
+		}
+
+		assert(spot < PARKED);
+
+		auto &b = buckets[bucket];
+
+		lot[spot] = parked_entry { entry, bucket, (uint32_t)b.size() };
+		b.push_back(spot);
+
+		faces.slot(entry.face) = spot | PARKED;
+		parked_count++;
+	}
+
+	/**
+	 * Take an entry out of its bucket, by moving the last one in the bucket
+	 * into its place.
+	 */
+	void unpark(uint32_t spot)
+	{
+		auto &p = lot[spot];
+		auto &b = buckets[p.bucket];
+
+		auto last = b.back();
+		b[p.index] = last;
+		lot[last].index = p.index;
+		b.pop_back();
+
+		// Make sure nobody mistakes the spot for theirs before it's reused
+		p.entry.stamp = 0;
+		free_spots.push_back(spot);
+		parked_count--;
+	}
+
+	/**
+	 * The front is empty: move the next bucket down into it. The buckets
+	 * above the front are always empty, so the walk only ever goes down, and
+	 * since the circles shrink so slowly, it's usually just a step.
+	 */
+	void refill()
+	{
+		if (parked_count == 0) return;
+
+		assert(front_bucket > 0);
+
+		do {
+			front_bucket--;
+		} while (buckets[front_bucket].empty());
+
+		auto &b = buckets[front_bucket];
+
+		for (auto spot : b) {
+			front.push(lot[spot].entry);
+
+			lot[spot].entry.stamp = 0;
+			free_spots.push_back(spot);
+		}
+
+		parked_count -= b.size();
+		b.clear();
+	}
+};
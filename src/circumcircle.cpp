@@ -0,0 +1,241 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "circumcircle.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define IVS_X86 1
+#include <immintrin.h>
+#else
+#define IVS_X86 0
+#endif
+
+/**
+ * One circle. With b and c being the other two corners relative to the first
+ * one, the center (relative to the first corner) is
+ *
+ *   ux = (cy |b|^2 - by |c|^2) / d
+ *   uy = (bx |c|^2 - cx |b|^2) / d
+ *
+ * where d = 2 (bx cy - by cx) (twice the signed area). The SIMD versions below
+ * are this, line by line.
+ */
+static inline void circle_kernel(
+	double x0, double y0, double x1, double y1, double x2, double y2,
+	double &cx, double &cy, double &r2)
+{
+	double bx = x1 - x0;
+	double by = y1 - y0;
+	double qx = x2 - x0;
+	double qy = y2 - y0;
+
+	double b2 = bx * bx + by * by;
+	double q2 = qx * qx + qy * qy;
+
+	double inv = 0.5 / (bx * qy - by * qx);
+
+	double ux = (qy * b2 - by * q2) * inv;
+	double uy = (bx * q2 - qx * b2) * inv;
+
+	cx = x0 + ux;
+	cy = y0 + uy;
+	r2 = ux * ux + uy * uy;
+}
+
+/**
+ * Lexicographic order for the corners.
+ */
+static inline bool corner_less(vec2 a, vec2 b)
+{
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+void circumcircle(vec2 p0, vec2 p1, vec2 p2, vec2 &center, double &r2)
+{
+	if (corner_less(p1, p0)) std::swap(p0, p1);
+	if (corner_less(p2, p1)) std::swap(p1, p2);
+	if (corner_less(p1, p0)) std::swap(p0, p1);
+
+	circle_kernel(p0.x, p0.y, p1.x, p1.y, p2.x, p2.y, center.x, center.y, r2);
+}
+
+struct circle_arrays
+{
+	const double *x0, *y0, *x1, *y1, *x2, *y2;
+	double *cx, *cy, *r2;
+};
+
+static void circles_scalar(const circle_arrays &a, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		circle_kernel(a.x0[i], a.y0[i], a.x1[i], a.y1[i], a.x2[i], a.y2[i], a.cx[i], a.cy[i], a.r2[i]);
+	}
+}
+
+#if IVS_X86
+
+__attribute__((target("sse2")))
+static void circles_sse2(const circle_arrays &a, size_t n)
+{
+	const __m128d half = _mm_set1_pd(0.5);
+	size_t i = 0;
+
+	for (; i + 2 <= n; i += 2) {
+		__m128d x0 = _mm_loadu_pd(a.x0 + i);
+		__m128d y0 = _mm_loadu_pd(a.y0 + i);
+
+		__m128d bx = _mm_sub_pd(_mm_loadu_pd(a.x1 + i), x0);
+		__m128d by = _mm_sub_pd(_mm_loadu_pd(a.y1 + i), y0);
+		__m128d qx = _mm_sub_pd(_mm_loadu_pd(a.x2 + i), x0);
+		__m128d qy = _mm_sub_pd(_mm_loadu_pd(a.y2 + i), y0);
+
+		__m128d b2 = _mm_add_pd(_mm_mul_pd(bx, bx), _mm_mul_pd(by, by));
+		__m128d q2 = _mm_add_pd(_mm_mul_pd(qx, qx), _mm_mul_pd(qy, qy));
+
+		__m128d inv = _mm_div_pd(half, _mm_sub_pd(_mm_mul_pd(bx, qy), _mm_mul_pd(by, qx)));
+
+		__m128d ux = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(qy, b2), _mm_mul_pd(by, q2)), inv);
+		__m128d uy = _mm_mul_pd(_mm_sub_pd(_mm_mul_pd(bx, q2), _mm_mul_pd(qx, b2)), inv);
+
+		_mm_storeu_pd(a.cx + i, _mm_add_pd(x0, ux));
+		_mm_storeu_pd(a.cy + i, _mm_add_pd(y0, uy));
+		_mm_storeu_pd(a.r2 + i, _mm_add_pd(_mm_mul_pd(ux, ux), _mm_mul_pd(uy, uy)));
+	}
+
+	circles_scalar(a, i, n);
+}
+
+__attribute__((target("avx2")))
+static void circles_avx2(const circle_arrays &a, size_t n)
+{
+	const __m256d half = _mm256_set1_pd(0.5);
+	size_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m256d x0 = _mm256_loadu_pd(a.x0 + i);
+		__m256d y0 = _mm256_loadu_pd(a.y0 + i);
+
+		__m256d bx = _mm256_sub_pd(_mm256_loadu_pd(a.x1 + i), x0);
+		__m256d by = _mm256_sub_pd(_mm256_loadu_pd(a.y1 + i), y0);
+		__m256d qx = _mm256_sub_pd(_mm256_loadu_pd(a.x2 + i), x0);
+		__m256d qy = _mm256_sub_pd(_mm256_loadu_pd(a.y2 + i), y0);
+
+		__m256d b2 = _mm256_add_pd(_mm256_mul_pd(bx, bx), _mm256_mul_pd(by, by));
+		__m256d q2 = _mm256_add_pd(_mm256_mul_pd(qx, qx), _mm256_mul_pd(qy, qy));
+
+		__m256d inv = _mm256_div_pd(half, _mm256_sub_pd(_mm256_mul_pd(bx, qy), _mm256_mul_pd(by, qx)));
+
+		__m256d ux = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(qy, b2), _mm256_mul_pd(by, q2)), inv);
+		__m256d uy = _mm256_mul_pd(_mm256_sub_pd(_mm256_mul_pd(bx, q2), _mm256_mul_pd(qx, b2)), inv);
+
+		_mm256_storeu_pd(a.cx + i, _mm256_add_pd(x0, ux));
+		_mm256_storeu_pd(a.cy + i, _mm256_add_pd(y0, uy));
+		_mm256_storeu_pd(a.r2 + i, _mm256_add_pd(_mm256_mul_pd(ux, ux), _mm256_mul_pd(uy, uy)));
+	}
+
+	circles_scalar(a, i, n);
+}
+
+#endif
+
+simd_level best_simd_level()
+{
+#if IVS_X86
+	static const simd_level level = __builtin_cpu_supports("avx2") ? simd_level::avx2 : simd_level::sse2;
+	return level;
+#else
+	return simd_level::scalar;
+#endif
+}
+
+const char *simd_level_name(simd_level level)
+{
+	switch (level) {
+	case simd_level::avx2: return "avx2";
+	case simd_level::sse2: return "sse2";
+	default:               return "scalar";
+	}
+}
+
+void circle_batch::clear()
+{
+	x0.clear();
+	y0.clear();
+	x1.clear();
+	y1.clear();
+	x2.clear();
+	y2.clear();
+}
+
+/**
+ * Swap a and b if b comes first. Written with selects instead of std::swap,
+ * since which way it goes is a coin flip and the branch would mispredict half
+ * of the time.
+ */
+static inline void corner_sort2(vec2 &a, vec2 &b)
+{
+	bool swap = corner_less(b, a);
+	vec2 lo = swap ? b : a;
+	vec2 hi = swap ? a : b;
+
+	a = lo;
+	b = hi;
+}
+
+void circle_batch::push(vec2 p0, vec2 p1, vec2 p2)
+{
+	corner_sort2(p0, p1);
+	corner_sort2(p1, p2);
+	corner_sort2(p0, p1);
+
+	x0.push_back(p0.x);
+	y0.push_back(p0.y);
+	x1.push_back(p1.x);
+	y1.push_back(p1.y);
+	x2.push_back(p2.x);
+	y2.push_back(p2.y);
+}
+
+void circle_batch::compute(simd_level level)
+{
+	auto n = size();
+
+	cx.resize(n);
+	cy.resize(n);
+	rr.resize(n);
+
+	circle_arrays a {
+		x0.data(), y0.data(), x1.data(), y1.data(), x2.data(), y2.data(),
+		cx.data(), cy.data(), rr.data() };
+
+	switch (level) {
+#if IVS_X86
+	case simd_level::avx2:
+		circles_avx2(a, n);
+		break;
+	case simd_level::sse2:
+		circles_sse2(a, n);
+		break;
+#endif
+	default:
+		circles_scalar(a, 0, n);
+		break;
+	}
+}
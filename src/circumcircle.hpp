@@ -0,0 +1,84 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Circumcircles, lots of them at once.
+ *
+ * The generator computes a circumcircle for every face it ever creates, which
+ * for a big set is a couple of billion of them. circumcircle_center (in
+ * utility.cpp) does it by intersecting two perpendicular bisectors, which is
+ * easy to follow but full of branches and divisions. This does the closed
+ * form version instead, on a whole batch of triangles stored as separate
+ * arrays, so it can do 2 (SSE2) or 4 (AVX2) circles per instruction.
+ *
+ * Every path does exactly the same operations in exactly the same order, so
+ * they all give the same results, down to the last bit. That matters: which
+ * circle is the biggest decides which point comes next, so a different last
+ * bit could mean a different set depending on which CPU you ran it on. (It's
+ * also why the library is built with -ffp-contract=off, a fused multiply-add
+ * rounds differently.)
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+/**
+ * Which instruction set to compute circles with.
+ */
+enum class simd_level { scalar, sse2, avx2 };
+
+/**
+ * The best one this CPU supports.
+ */
+simd_level best_simd_level();
+
+const char *simd_level_name(simd_level level);
+
+/**
+ * A batch of triangles going in and their circumcircles coming out. Fill it up
+ * with push, call compute, read the results. Keep one around and clear it
+ * instead of making new ones, so the arrays don't have to be allocated again.
+ */
+class circle_batch
+{
+public:
+	void clear();
+
+	size_t size() const { return x0.size(); }
+
+	/**
+	 * Add a triangle. The corners are sorted first, so the circle is the same
+	 * no matter which order they're given in (see circumcircle in ivs.hpp).
+	 */
+	void push(vec2 p0, vec2 p1, vec2 p2);
+
+	/**
+	 * Compute the circles of everything that's been pushed.
+	 */
+	void compute(simd_level level = best_simd_level());
+
+	vec2 center(size_t i) const { return vec2 { cx[i], cy[i] }; }
+	double r2(size_t i) const { return rr[i]; }
+
+private:
+	std::vector<double> x0, y0, x1, y1, x2, y2;
+	std::vector<double> cx, cy, rr;
+};
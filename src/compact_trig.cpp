@@ -0,0 +1,408 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * A compact periodic Delaunay triangulation, as an alternative to CGAL's for
+ * the one-sheet part of the algorithm.
+ *
+ * CGAL's triangulation is great, but it's general: every vertex and face is a
+ * separately allocated thing full of pointers, and for 10+ million points that
+ * ends up being most of the memory we use, with cache misses everywhere. The
+ * IVS loop only ever does one thing to the triangulation though: insert a point
+ * at the circumcenter of a face we already know about. So this only does that.
+ *
+ * Everything is stored in flat arrays indexed by 32-bit integers: vertex
+ * coordinates in one array per axis, and per face corner the vertex, the
+ * periodic offset of the vertex and the neighboring face. Faces are never
+ * deleted, the faces destroyed by an insertion are reused for the new ones
+ * (there's always exactly two more new faces than destroyed ones, since a
+ * triangulation of the torus has twice as many faces as vertices).
+ *
+ * Insertion is plain Bowyer-Watson: starting from the face we popped off the
+ * queue, flood out over every face whose circumcircle contains the point, then
+ * connect the new point to the boundary of that region. Since the domain wraps
+ * around, every face we visit gets a translation that lines it up with the face
+ * we started in, so that all the coordinates in the zone are consistent.
+ *
+ * It doesn't do the nine-sheet part: we let CGAL deal with that, and copy the
+ * triangulation over once it's switched to one-sheet mode. The predicates are
+ * CGAL's too (exact, with the same symbolic perturbation as CGAL uses for
+ * co-circular points), so it produces exactly the same triangulation as CGAL
+ * would, and hence exactly the same set.
+ */
+
+#include "compact_trig.hpp"
+
+#include <stdexcept>
+#include <unordered_map>
+
+static inline uint32_t ccw(uint32_t i) { return i == 2 ? 0 : i + 1; }
+static inline uint32_t cw(uint32_t i)  { return i == 0 ? 2 : i - 1; }
+
+compact_trig::compact_trig()
+{
+}
+
+compact_trig::compact_trig(const PDT &trig)
+{
+	assign(trig);
+}
+
+void compact_trig::assign(const PDT &trig)
+{
+	assert(trig.number_of_sheets()[0] * trig.number_of_sheets()[1] == 1);
+
+	traits = trig.geom_traits();
+
+	// clear() keeps the memory around, which is the whole point of reusing
+	// one of these
+	xs.clear();
+	ys.clear();
+	corner_vertex.clear();
+	corner_ox.clear();
+	corner_oy.clear();
+	corner_neighbor.clear();
+	infos.clear();
+
+	std::unordered_map<const void *, uint32_t> vertex_index;
+	std::unordered_map<const void *, uint32_t> face_index;
+
+	xs.reserve(trig.number_of_vertices());
+	ys.reserve(trig.number_of_vertices());
+
+	for (auto it = trig.vertices_begin(); it != trig.vertices_end(); it++) {
+		vertex_index[&*it] = xs.size();
+
+		xs.push_back(it->point().x());
+		ys.push_back(it->point().y());
+	}
+
+	for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+		face_index[&*it] = add_face();
+	}
+
+	for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+		PDT::Face_handle face = it;
+
+		auto f = face_index[&*face];
+		auto triangle = trig.periodic_triangle(face);
+
+		// Store the offsets so that the smallest one is 0 in each direction.
+		// Doesn't change anything geometrically, but it means that we and the
+		// CGAL path compute circumcircles from exactly the same numbers.
+		int mx = std::min({ triangle[0].second.x(), triangle[1].second.x(), triangle[2].second.x() });
+		int my = std::min({ triangle[0].second.y(), triangle[1].second.y(), triangle[2].second.y() });
+
+		for (uint32_t k = 0; k < 3; k++) {
+			auto v = vertex_index[&*face->vertex(k)];
+
+			corner_vertex[3*f + k] = v;
+			corner_ox[3*f + k] = (int8_t)(triangle[k].second.x() - mx);
+			corner_oy[3*f + k] = (int8_t)(triangle[k].second.y() - my);
+
+			// Find which corner of the neighbor points back at us. Checking
+			// the vertex as well makes sure we get the right edge, even if
+			// two faces happen to share more than one.
+			auto neighbor = face->neighbor(k);
+			uint32_t mirror = 0;
+
+			while (mirror < 3 && !(neighbor->neighbor(mirror) == face
+				&& neighbor->vertex(cw(mirror)) == face->vertex(ccw(k))))
+			{
+				mirror++;
+			}
+
+			assert(mirror < 3);
+
+			corner_neighbor[3*f + k] = face_index[&*neighbor] << 2 | mirror;
+		}
+	}
+}
+
+void compact_trig::reserve(size_t vertices)
+{
+	if (vertices > MAX_VERTICES) {
+		throw std::length_error("Too many vertices for a compact_trig");
+	}
+
+	// A triangulation of the torus always has exactly twice as many faces as
+	// vertices
+	auto faces = 2 * vertices;
+
+	xs.reserve(vertices);
+	ys.reserve(vertices);
+	corner_vertex.reserve(3 * faces);
+	corner_ox.reserve(3 * faces);
+	corner_oy.reserve(3 * faces);
+	corner_neighbor.reserve(3 * faces);
+	infos.reserve(faces);
+}
+
+uint32_t compact_trig::add_face()
+{
+	// Past this, face << 2 in corner_neighbor loses the top bits, and the
+	// adjacency would quietly point at the wrong faces
+	if (infos.size() >= MAX_FACES) {
+		throw std::length_error("Too many faces for a compact_trig");
+	}
+
+	auto f = (uint32_t)infos.size();
+
+	for (int k = 0; k < 3; k++) {
+		corner_vertex.push_back(0);
+		corner_ox.push_back(0);
+		corner_oy.push_back(0);
+		corner_neighbor.push_back(0);
+	}
+
+	infos.emplace_back();
+
+	return f;
+}
+
+void compact_trig::triangle(uint32_t face, vec2 &p0, vec2 &p1, vec2 &p2) const
+{
+	auto corner = [&](uint32_t k) {
+		auto v = corner_vertex[3*face + k];
+
+		return vec2 { xs[v] + corner_ox[3*face + k], ys[v] + corner_oy[3*face + k] };
+	};
+
+	p0 = corner(0);
+	p1 = corner(1);
+	p2 = corner(2);
+}
+
+/**
+ * Is the point of the zone inside the circumcircle of the face (moved by tx,
+ * ty)? This is CGAL's exact in-circle test, and if the point is exactly on the
+ * circle, the same symbolic perturbation CGAL's Delaunay triangulations use
+ * (look at the points in lexicographic order and pretend the largest one is
+ * moved a tiny bit). That way, degenerate cases go the same way here as in
+ * CGAL.
+ */
+bool compact_trig::in_conflict(uint32_t face, int32_t tx, int32_t ty, const conflict_zone &zone) const
+{
+	PDT::Point p[4];
+	PDT::Offset o[4];
+
+	for (uint32_t k = 0; k < 3; k++) {
+		auto v = corner_vertex[3*face + k];
+
+		p[k] = PDT::Point { xs[v], ys[v] };
+		o[k] = PDT::Offset { corner_ox[3*face + k] + tx, corner_oy[3*face + k] + ty };
+	}
+
+	p[3] = PDT::Point { zone.point.x, zone.point.y };
+	o[3] = PDT::Offset { zone.ox, zone.oy };
+
+	auto side = traits.side_of_oriented_circle_2_object()(
+		p[0], p[1], p[2], p[3], o[0], o[1], o[2], o[3]);
+
+	if (side != CGAL::ON_ORIENTED_BOUNDARY) {
+		return side == CGAL::ON_POSITIVE_SIDE;
+	}
+
+	auto compare_xy = traits.compare_xy_2_object();
+	auto orientation = traits.orientation_2_object();
+
+	int order[4] = { 0, 1, 2, 3 };
+
+	std::sort(order, order + 4, [&](int a, int b) {
+		return compare_xy(p[a], p[b], o[a], o[b]) == CGAL::SMALLER;
+	});
+
+	for (int i = 3; i > 1; i--) {
+		CGAL::Orientation orient;
+
+		if (order[i] == 3) {
+			return false;
+		}
+
+		if (order[i] == 2) {
+			orient = orientation(p[0], p[1], p[3], o[0], o[1], o[3]);
+		} else if (order[i] == 1) {
+			orient = orientation(p[0], p[3], p[2], o[0], o[3], o[2]);
+		} else {
+			orient = orientation(p[3], p[1], p[2], o[3], o[1], o[2]);
+		}
+
+		if (orient != CGAL::COLLINEAR) {
+			return orient == CGAL::COUNTERCLOCKWISE;
+		}
+	}
+
+	return false;
+}
+
+void compact_trig::find_conflicts(vec2 local, vec2 point, uint32_t start, conflict_zone &zone) const
+{
+	zone.point = point;
+	zone.ox = (int32_t)std::lround(local.x - point.x);
+	zone.oy = (int32_t)std::lround(local.y - point.y);
+
+	zone.faces.clear();
+	zone.tx.clear();
+	zone.ty.clear();
+	zone.boundary.clear();
+	zone.outside.clear();
+
+	assert(in_conflict(start, 0, 0, zone));
+
+	zone.faces.push_back(start);
+	zone.tx.push_back(0);
+	zone.ty.push_back(0);
+
+	// The zones are tiny (usually 4 or 5 faces), so linear searches are
+	// faster than anything clever here.
+	auto contains = [](const std::vector<uint32_t> &faces, uint32_t face) {
+		return std::find(faces.begin(), faces.end(), face) != faces.end();
+	};
+
+	for (size_t n = 0; n < zone.faces.size(); n++) {
+		auto f = zone.faces[n];
+		auto tx = zone.tx[n];
+		auto ty = zone.ty[n];
+
+		for (uint32_t i = 0; i < 3; i++) {
+			auto neighbor = corner_neighbor[3*f + i];
+			auto g = neighbor >> 2;
+			auto mirror = neighbor & 3;
+
+			if (contains(zone.faces, g)) continue;
+
+			if (!contains(zone.outside, g)) {
+				// Line the neighbor up with us using a vertex we share: the
+				// one after corner i in f is the one before the mirror corner
+				// in g.
+				auto a = ccw(i);
+				auto b = cw(mirror);
+
+				int32_t gtx = corner_ox[3*f + a] + tx - corner_ox[3*g + b];
+				int32_t gty = corner_oy[3*f + a] + ty - corner_oy[3*g + b];
+
+				if (in_conflict(g, gtx, gty, zone)) {
+					zone.faces.push_back(g);
+					zone.tx.push_back(gtx);
+					zone.ty.push_back(gty);
+					continue;
+				}
+
+				zone.outside.push_back(g);
+			}
+
+			zone.boundary.push_back(boundary_edge { f, i, tx, ty });
+		}
+	}
+
+	assert(zone.boundary.size() == zone.faces.size() + 2);
+}
+
+uint32_t compact_trig::insert(const conflict_zone &zone, std::vector<uint32_t> &created)
+{
+	auto nv = (uint32_t)xs.size();
+
+	xs.push_back(zone.point.x);
+	ys.push_back(zone.point.y);
+
+	// Grab everything we need to know about the boundary before we start
+	// overwriting the faces of the zone.
+	rim.clear();
+
+	for (auto &edge : zone.boundary) {
+		auto f = edge.face;
+		auto a = ccw(edge.corner);
+		auto c = cw(edge.corner);
+
+		rim.push_back(rim_edge {
+			corner_vertex[3*f + a],
+			corner_vertex[3*f + c],
+			corner_ox[3*f + a] + edge.tx, corner_oy[3*f + a] + edge.ty,
+			corner_ox[3*f + c] + edge.tx, corner_oy[3*f + c] + edge.ty,
+			corner_neighbor[3*f + edge.corner] });
+	}
+
+	created.assign(zone.faces.begin(), zone.faces.end());
+
+	while (created.size() < rim.size()) {
+		created.push_back(add_face());
+	}
+
+	// Every edge on the boundary gets a new face, (new vertex, a, c), which is
+	// counter-clockwise since the new point is on the same side of the edge as
+	// the face that used to be there.
+	for (size_t j = 0; j < rim.size(); j++) {
+		auto f = created[j];
+		auto &r = rim[j];
+
+		int32_t mx = std::min({ zone.ox, r.ax, r.cx });
+		int32_t my = std::min({ zone.oy, r.ay, r.cy });
+
+		corner_vertex[3*f + 0] = nv;
+		corner_vertex[3*f + 1] = r.a;
+		corner_vertex[3*f + 2] = r.c;
+
+		corner_ox[3*f + 0] = (int8_t)(zone.ox - mx);
+		corner_oy[3*f + 0] = (int8_t)(zone.oy - my);
+		corner_ox[3*f + 1] = (int8_t)(r.ax - mx);
+		corner_oy[3*f + 1] = (int8_t)(r.ay - my);
+		corner_ox[3*f + 2] = (int8_t)(r.cx - mx);
+		corner_oy[3*f + 2] = (int8_t)(r.cy - my);
+
+		// Hook up the face on the other side of the boundary
+		corner_neighbor[3*f + 0] = r.outside;
+		corner_neighbor[3*(r.outside >> 2) + (r.outside & 3)] = f << 2 | 0;
+
+		infos[f] = face_info {};
+	}
+
+	// Hook the new faces up to each other. The edge (c, new) of one face is
+	// the edge (new, a) of the face whose a is our c.
+	for (size_t j = 0; j < rim.size(); j++) {
+		size_t l = 0;
+
+		while (l < rim.size() && !(rim[l].a == rim[j].c
+			&& rim[l].ax == rim[j].cx && rim[l].ay == rim[j].cy))
+		{
+			l++;
+		}
+
+		assert(l < rim.size());
+
+		corner_neighbor[3*created[j] + 1] = created[l] << 2 | 2;
+		corner_neighbor[3*created[l] + 2] = created[j] << 2 | 1;
+	}
+
+	return nv;
+}
+
+PDT compact_trig::to_pdt() const
+{
+	std::vector<PDT::Point> points;
+	points.reserve(xs.size());
+
+	for (size_t v = 0; v < xs.size(); v++) {
+		points.emplace_back(xs[v], ys[v]);
+	}
+
+	PDT trig { PDT::Iso_rectangle { 0, 0, 1, 1 } };
+	trig.insert(points.begin(), points.end(), true);
+
+	return trig;
+}
@@ -0,0 +1,166 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * A small, special purpose periodic Delaunay triangulation. See compact_trig.cpp
+ * for the details.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+class compact_trig
+{
+public:
+	/**
+	 * One edge on the boundary of a conflict zone. The edge is the one
+	 * opposite `corner` in `face` (which is inside the zone), and (tx, ty) is
+	 * how much face has to be moved to line up with the starting face of the
+	 * zone.
+	 */
+	struct boundary_edge {
+		uint32_t face;
+		uint32_t corner;
+		int32_t tx;
+		int32_t ty;
+	};
+
+	/**
+	 * All the faces a new point is in conflict with (i.e. the faces that will
+	 * be destroyed when it's inserted), and the boundary of that region. The
+	 * point is stored in [0,1), and (ox, oy) is its offset relative to the
+	 * starting face.
+	 */
+	struct conflict_zone {
+		vec2 point;
+		int32_t ox;
+		int32_t oy;
+
+		std::vector<uint32_t> faces;
+		std::vector<int32_t> tx;
+		std::vector<int32_t> ty;
+		std::vector<boundary_edge> boundary;
+
+		// Faces we've looked at that turned out not to be in conflict
+		std::vector<uint32_t> outside;
+	};
+
+	/**
+	 * An empty triangulation, to assign() to later.
+	 */
+	compact_trig();
+
+	/**
+	 * Copy a CGAL triangulation. It has to be in one-sheet mode.
+	 */
+	explicit compact_trig(const PDT &trig);
+
+	/**
+	 * Replace the contents with a copy of a CGAL triangulation, reusing the
+	 * memory of whatever was there before.
+	 */
+	void assign(const PDT &trig);
+
+	/**
+	 * Make room for this many vertices, so that inserting up to that many
+	 * doesn't allocate. Throws std::length_error if it's more than
+	 * MAX_VERTICES.
+	 */
+	void reserve(size_t vertices);
+
+	/**
+	 * Most vertices (and faces) it can hold. Neighbors are stored as a face
+	 * index and a corner packed into 32 bits (see corner_neighbor), which
+	 * leaves 30 bits for the face, and there are twice as many faces as
+	 * vertices. reserve and insert throw std::length_error past this.
+	 */
+	static constexpr size_t MAX_FACES = size_t(1) << 30;
+	static constexpr size_t MAX_VERTICES = MAX_FACES / 2;
+
+	size_t number_of_vertices() const { return xs.size(); }
+	size_t number_of_faces() const { return infos.size(); }
+
+	vec2 vertex(uint32_t v) const { return vec2 { xs[v], ys[v] }; }
+
+	/**
+	 * The corners of a face, moved so that they are all next to each other
+	 * (so the coordinates may be outside [0,1)).
+	 */
+	void triangle(uint32_t face, vec2 &p0, vec2 &p1, vec2 &p2) const;
+
+	/**
+	 * Find the conflict zone of a point, starting from a face that's known to
+	 * be in conflict with it. `local` is the point in the coordinates of the
+	 * start face (as given by triangle()), `point` is the same point wrapped
+	 * into [0,1).
+	 *
+	 * Doesn't modify the triangulation, so it's fine to call from several
+	 * threads at once (with different zones).
+	 */
+	void find_conflicts(vec2 local, vec2 point, uint32_t start, conflict_zone &zone) const;
+
+	/**
+	 * Insert the point of a conflict zone. The faces of the zone are destroyed
+	 * (their indices get reused) and the new faces, which all have the new
+	 * vertex as corner 0, are put in `created`. Returns the new vertex.
+	 */
+	uint32_t insert(const conflict_zone &zone, std::vector<uint32_t> &created);
+
+	face_info &info(uint32_t face) { return infos[face]; }
+	const face_info &info(uint32_t face) const { return infos[face]; }
+
+	/**
+	 * Make a CGAL triangulation out of the vertices, for drawing.
+	 */
+	PDT to_pdt() const;
+
+private:
+	GT traits;
+
+	// Vertex coordinates (always in [0,1))
+	std::vector<double> xs;
+	std::vector<double> ys;
+
+	// Per face corner (so three entries per face): the vertex, the offset of
+	// the vertex, and the neighboring face across the edge opposite the
+	// corner. Neighbors are stored as (face << 2 | corner), where corner is
+	// the corner of the neighbor that points back at us.
+	std::vector<uint32_t> corner_vertex;
+	std::vector<int8_t> corner_ox;
+	std::vector<int8_t> corner_oy;
+	std::vector<uint32_t> corner_neighbor;
+
+	std::vector<face_info> infos;
+
+	/**
+	 * Scratch space for insert.
+	 */
+	struct rim_edge {
+		uint32_t a, c;
+		int32_t ax, ay, cx, cy;
+		uint32_t outside;
+	};
+
+	std::vector<rim_edge> rim;
+
+	uint32_t add_face();
+
+	bool in_conflict(uint32_t face, int32_t tx, int32_t ty, const conflict_zone &zone) const;
+};
@@ -17,160 +17,693 @@
  * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include "main.hpp"
+#include "ivs.hpp"
+#include "circumcircle.hpp"
+#include "site_raster.hpp"
+#include "worker_pool.hpp"
 
 #include <cairo.h>
+#include <unordered_map>
+#include <unordered_set>
 
-static void draw_wrapped_line(cairo_t *cr, float x0, float y0, float x1, float y1)
+/**
+ * Set up a context so that the unit square covers the whole image, with (0,0)
+ * bottom left and (1,1) top right. The surface is the part of the image that
+ * starts at pixel (x0, y0), which is the whole thing unless it's a tile.
+ */
+static cairo_t *create_context(
+	cairo_surface_t *surface,
+	const draw_options &draw,
+	int32_t x0 = 0,
+	int32_t y0 = 0)
 {
-	cairo_move_to(cr, x0, y0);
-	cairo_line_to(cr, x1, y1);
+	auto size = draw.img_size;
+	auto cr = cairo_create(surface);
 
-	auto outside = [](float v) { return v < 0 || v >= 1; };
-	
-	if (outside(x0) || outside(y0) || outside(x1) || outside(y1)) {
-		cairo_move_to(cr, x0-1, y0-1);
-		cairo_line_to(cr, x1-1, y1-1);
+	cairo_translate(cr, -x0, -y0);
+	cairo_scale(cr, 1, -1);
+	cairo_translate(cr, 0, -(double)size);
+	cairo_scale(cr, size, size);
 
-		cairo_move_to(cr, x0  , y0-1);
-		cairo_line_to(cr, x1  , y1-1);
+	cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+	cairo_set_line_width(cr, draw.line_width / size);
 
-		cairo_move_to(cr, x0+1, y0-1);
-		cairo_line_to(cr, x1+1, y1-1);
+	return cr;
+}
 
-		cairo_move_to(cr, x0-1, y0  );
-		cairo_line_to(cr, x1-1, y1  );
+/**
+ * Axis aligned rectangle, for the dirty region tracking below. 
+ */
+struct rect
+{
+	vec2 min;
+	vec2 max;
 
-		cairo_move_to(cr, x0+1, y0  );
-		cairo_line_to(cr, x1+1, y1  );
+	static rect empty()
+	{
+		auto inf = std::numeric_limits<double>::infinity();
+		return rect { vec2 { inf, inf }, vec2 { -inf, -inf } };
+	}
 
-		cairo_move_to(cr, x0-1, y0+1);
-		cairo_line_to(cr, x1-1, y1+1);
+	static rect around(vec2 center, double radius)
+	{
+		return rect { center - radius, center + radius };
+	}
 
-		cairo_move_to(cr, x0  , y0+1);
-		cairo_line_to(cr, x1  , y1+1);
+	void add(const rect &r)
+	{
+		min = glm::min(min, r.min);
+		max = glm::max(max, r.max);
+	}
 
-		cairo_move_to(cr, x0+1, y0+1);
-		cairo_line_to(cr, x1+1, y1+1);
+	vec2 size() const { return max - min; }
+};
 
+/**
+ * Is there a whole-number shift that makes r overlap d? (I.e. do they overlap
+ * on the torus?) If so, it's put in shift. Both have to be less than one unit
+ * across for the answer to be unique.
+ */
+static bool torus_overlap(const rect &r, const rect &d, vec2 &shift)
+{
+	for (int k = 0; k < 2; k++) {
+		// Smallest shift that gets r's max past d's min
+		double s = std::ceil(d.min[k] - r.max[k]);
+
+		if (r.min[k] + s > d.max[k]) return false;
+
+		shift[k] = s;
 	}
+
+	return true;
 }
 
-static void draw_triangles(const PDT &trig, cairo_t *cr)
+/**
+ * The corners of a face, in a consistent periodic copy.
+ */
+static void face_points(const PDT &trig, PDT::Face_handle face, vec2 p[3])
 {
-	auto tb = trig.faces_begin();
-	auto te = trig.faces_end();
+	auto triangle = trig.periodic_triangle(face);
 
-	int i = 0;
-	
-	for (auto it = tb; it != te; i++, it++) {
-		auto p0 = point(trig, trig.periodic_triangle(it)[0]);
-		auto p1 = point(trig, trig.periodic_triangle(it)[1]);
-		auto p2 = point(trig, trig.periodic_triangle(it)[2]);
-
-        cairo_new_sub_path(cr);
-        draw_wrapped_line(cr, p0.x, p0.y, p1.x, p1.y);
-        draw_wrapped_line(cr, p1.x, p1.y, p2.x, p2.y);
-        draw_wrapped_line(cr, p2.x, p2.y, p0.x, p0.y);
-        cairo_close_path(cr);
+	for (int k = 0; k < 3; k++) {
+		p[k] = point(trig, triangle[k]);
 	}
+}
+
+/**
+ * The circumscribed disk of a face, grown by margin. Everything that gets
+ * drawn for a face (its edges, its circle, the Voronoi edges to its neighbors
+ * and its corners) is inside its disk, grown by the line width or point size.
+ * The Voronoi edges might not look like they are, but the edge between two
+ * faces is on the line through both centers, and both disks contain the
+ * midpoint of the shared edge, so it's inside the two disks together.
+ */
+static rect face_disk(const PDT &trig, PDT::Face_handle face, double margin)
+{
+	vec2 p[3];
+	face_points(trig, face, p);
 
-	cairo_stroke(cr);
+	vec2 center;
+	double r2;
+	circumcircle(p[0], p[1], p[2], center, r2);
+
+	return rect::around(center, std::sqrt(r2) + margin);
 }
 
-static void draw_circumcircles(const PDT &trig, cairo_t *cr)
+/**
+ * The decorations of a whole triangulation (circumcircles, Delaunay edges and
+ * Voronoi edges) used to be drawn by one Cairo context on one thread, and
+ * every edge that touched the border of the image was drawn nine times, in
+ * case it wrapped around. Now the image is split into tiles, every shape is
+ * sorted into the tiles it shows up in (for just the copies of it that are
+ * actually on the image, which is where the wrapping is dealt with), and the
+ * tiles are drawn in parallel, each with its own context.
+ *
+ * The circumcenters are computed once per face (with circle_batch), and the
+ * Voronoi edges are drawn between them, instead of asking CGAL for the dual of
+ * every edge, which computes both circumcenters all over again.
+ */
+static const int32_t TILE_SIZE = 256;
+
+// Drawing fewer shapes than this isn't worth starting threads for
+static const size_t PARALLEL_SHAPES = 16384;
+
+/**
+ * One kind of decoration: lines from a[k] to b[k], or circles around a[k]
+ * with radius b[k].x. Each tile has a list of the shapes that show up in it,
+ * and how far they need to be moved to get there.
+ */
+struct overlay_layer
 {
-	auto tb = trig.periodic_triangles_begin();
-	auto te = trig.periodic_triangles_end();
+	struct item {
+		uint32_t shape;
+		int16_t tx;
+		int16_t ty;
+	};
 
-	for (auto it = tb; it != te; it++) {
-		auto p0 = point(trig, (*it)[0]);
-		auto p1 = point(trig, (*it)[1]);
-		auto p2 = point(trig, (*it)[2]);
+	bool circles;
+	vec4 color;
 
-		auto c = circumcircle_center(p0, p1, p2);
-		auto r = glm::length(c - p0);
+	std::vector<vec2> a;
+	std::vector<vec2> b;
 
-		cairo_move_to(cr, c.x + r, c.y);
-		cairo_arc(cr, c.x, c.y, r, 0, TAU);
+	std::vector<std::vector<item>> tiles;
+
+	overlay_layer(bool circles, vec4 color)
+		: circles { circles }
+		, color { color }
+	{
 	}
-}
 
-static void draw_voronoi(const PDT &trig, cairo_t *cr)
+	rect bounds(uint32_t k, double margin) const
+	{
+		if (circles) {
+			return rect::around(a[k], b[k].x + margin);
+		} else {
+			return rect { glm::min(a[k], b[k]) - margin, glm::max(a[k], b[k]) + margin };
+		}
+	}
+
+	/**
+	 * Put every shape in the tiles it shows up in, once for every copy of it
+	 * (moved by whole units) that's on the image.
+	 */
+	void sort_into_tiles(const draw_options &draw)
+	{
+		double size = draw.img_size;
+		double margin = (draw.line_width + 2) / size;
+		auto per_side = (int32_t)((draw.img_size + TILE_SIZE - 1) / TILE_SIZE);
+
+		tiles.assign((size_t)per_side * per_side, {});
+
+		auto tile_of = [&](double u) {
+			return std::min(std::max((int32_t)(u * size) / TILE_SIZE, 0), per_side - 1);
+		};
+
+		for (uint32_t k = 0; k < a.size(); k++) {
+			auto r = bounds(k, margin);
+
+			for (auto ty = std::ceil(-r.max.y); ty <= std::floor(1 - r.min.y); ty++) {
+				for (auto tx = std::ceil(-r.max.x); tx <= std::floor(1 - r.min.x); tx++) {
+					// Tile rows go down, y goes up
+					auto col0 = tile_of(r.min.x + tx);
+					auto col1 = tile_of(r.max.x + tx);
+					auto row0 = tile_of(1 - (r.max.y + ty));
+					auto row1 = tile_of(1 - (r.min.y + ty));
+
+					for (auto row = row0; row <= row1; row++) {
+						for (auto col = col0; col <= col1; col++) {
+							tiles[(size_t)row * per_side + col].push_back(
+								item { k, (int16_t)tx, (int16_t)ty });
+						}
+					}
+				}
+			}
+		}
+	}
+
+	void draw(cairo_t *cr, size_t tile) const
+	{
+		if (tiles[tile].empty()) return;
+
+		cairo_set_source_rgba(cr, color.x, color.y, color.z, color.w);
+		cairo_new_path(cr);
+
+		for (auto &it : tiles[tile]) {
+			vec2 shift { (double)it.tx, (double)it.ty };
+			auto p = a[it.shape] + shift;
+
+			if (circles) {
+				auto r = b[it.shape].x;
+
+				cairo_new_sub_path(cr);
+				cairo_arc(cr, p.x, p.y, r, 0, TAU);
+			} else {
+				auto q = b[it.shape] + shift;
+
+				cairo_move_to(cr, p.x, p.y);
+				cairo_line_to(cr, q.x, q.y);
+			}
+		}
+
+		cairo_stroke(cr);
+	}
+};
+
+/**
+ * Collect the decorations that are turned on.
+ */
+static std::vector<overlay_layer> collect_overlays(const PDT &trig, const draw_options &draw)
 {
-	auto eb = trig.edges_begin();
-	auto ee = trig.edges_end();
+	std::vector<overlay_layer> layers;
+
+	if (!draw.draw_circumcircles && !draw.draw_triangulation && !draw.draw_voronoi) {
+		return layers;
+	}
+
+	// Every face's corners (all in the same copy of the face) and its circle
+	std::vector<PDT::Face_handle> faces;
+	std::unordered_map<const void *, uint32_t> index;
+	std::vector<vec2> corners;
+	circle_batch circles;
 
-	for (auto it = eb; it != ee; it++) {
-		auto segment = trig.dual(it);
+	faces.reserve(trig.number_of_faces());
+	index.reserve(trig.number_of_faces());
+	corners.reserve(3 * trig.number_of_faces());
 
-		auto p0 = segment.source();
-		auto p1 = segment.target();
+	for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+		vec2 p[3];
+		face_points(trig, it, p);
 
-		draw_wrapped_line(cr, p0.x(), p0.y(), p1.x(), p1.y());
+		index[&*it] = (uint32_t)faces.size();
+		faces.push_back(it);
+		corners.insert(corners.end(), p, p + 3);
+		circles.push(p[0], p[1], p[2]);
 	}
 
-	cairo_stroke(cr);
+	circles.compute();
+
+	overlay_layer circle_layer { true, vec4 { 0.0, 0.0, 0.0, 0.3 } };
+	overlay_layer delaunay_layer { false, vec4 { 0.0, 0.0, 0.0, 1.0 } };
+	overlay_layer voronoi_layer { false, vec4 { 1.0, 0.0, 0.0, 1.0 } };
+
+	for (uint32_t k = 0; k < faces.size(); k++) {
+		if (draw.draw_circumcircles) {
+			circle_layer.a.push_back(circles.center(k));
+			circle_layer.b.push_back(vec2 { std::sqrt(circles.r2(k)), 0.0 });
+		}
+
+		for (int i = 0; i < 3; i++) {
+			auto neighbor = faces[k]->neighbor(i);
+			auto j = index[&*neighbor];
+
+			// Every edge shows up once from each side, only draw it from the
+			// one with the lower index
+			if (j < k) continue;
+
+			auto p0 = corners[3*k + (i + 1) % 3];
+			auto p1 = corners[3*k + (i + 2) % 3];
+
+			if (draw.draw_triangulation) {
+				delaunay_layer.a.push_back(p0);
+				delaunay_layer.b.push_back(p1);
+			}
+
+			if (draw.draw_voronoi) {
+				// The neighbor's circumcenter, moved into the same copy as
+				// this face: find one of the shared corners in it, and see
+				// how far apart the two copies of it are
+				auto corner = neighbor->index(faces[k]->vertex((i + 1) % 3));
+				auto shift = glm::round(p0 - corners[3*j + corner]);
+
+				voronoi_layer.a.push_back(circles.center(k));
+				voronoi_layer.b.push_back(circles.center(j) + shift);
+			}
+		}
+	}
+
+	for (auto layer : { &circle_layer, &delaunay_layer, &voronoi_layer }) {
+		if (!layer->a.empty()) {
+			layer->sort_into_tiles(draw);
+			layers.push_back(std::move(*layer));
+		}
+	}
+
+	return layers;
 }
 
-static void draw_sites(const PDT &trig, cairo_t *cr) {
+/**
+ * The dots go straight into the pixels instead of through Cairo, see
+ * site_raster.cpp.
+ */
+static void draw_sites(const PDT &trig, site_raster &raster, cairo_surface_t *surface) {
 	auto vb = trig.vertices_begin();
 	auto ve = trig.vertices_end();
 
+	std::vector<vec2> sites;
+	sites.reserve(trig.number_of_vertices());
+
 	for (auto it = vb; it != ve; it++) {
-		auto r = opts.point_size / opts.img_size;
-		
-		cairo_new_sub_path(cr);
-		cairo_move_to(cr, it->point().x() + r, it->point().y());
-		cairo_arc(cr, it->point().x(), it->point().y(), r, 0, TAU);
-		cairo_close_path(cr);
+		sites.emplace_back(it->point().x(), it->point().y());
 	}
 
-	cairo_fill(cr);
+	raster.draw(surface, sites);
 }
 
-void draw_trig(const char *file, const PDT &trig)
+/**
+ * Draw the whole triangulation, with whatever decorations are turned on, over
+ * whatever's there. The surface has to be an ARGB32 image, cr a context for
+ * it from create_context.
+ */
+static void paint_trig(const PDT &trig, const draw_options &draw, site_raster &raster, cairo_t *cr)
 {
-	auto size = opts.img_size;
+	auto surface = cairo_get_target(cr);
 
-	auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, opts.img_size, size);
-	auto cr = cairo_create(surface);
-
-	// Transform the canvas so that (0,0) is bottom left and (1,1) is top right
-	cairo_scale(cr, 1, -1);
-	cairo_translate(cr, 0, -size);
-	cairo_scale(cr, size, size),
-	
-	cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
-	
 	cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
 	cairo_paint(cr);
 
-	cairo_set_line_width(cr, opts.line_width / size);
+	auto layers = collect_overlays(trig, draw);
 
-	if (opts.draw_circumcircles) 
-	{
-		cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.3);
-		draw_circumcircles(trig, cr);
-		cairo_stroke(cr);
+	if (!layers.empty()) {
+		size_t shapes = 0;
+
+		for (auto &layer : layers) {
+			shapes += layer.a.size();
+		}
+
+		auto per_side = (int32_t)((draw.img_size + TILE_SIZE - 1) / TILE_SIZE);
+		auto tiles = (size_t)per_side * per_side;
+
+		cairo_surface_flush(surface);
+
+		auto data = cairo_image_surface_get_data(surface);
+		auto stride = cairo_image_surface_get_stride(surface);
+
+		// Every tile gets a surface of its own that draws straight into its
+		// part of the image, so they can all be drawn at once
+		worker_pool pool { shapes >= PARALLEL_SHAPES ? draw.threads : 1 };
+
+		pool.parallel_for(tiles, [&](size_t tile) {
+			auto x0 = (int32_t)(tile % per_side) * TILE_SIZE;
+			auto y0 = (int32_t)(tile / per_side) * TILE_SIZE;
+			auto w = std::min<int32_t>(TILE_SIZE, draw.img_size - x0);
+			auto h = std::min<int32_t>(TILE_SIZE, draw.img_size - y0);
+
+			auto part = cairo_image_surface_create_for_data(
+				data + (size_t)y0 * stride + (size_t)x0 * 4, CAIRO_FORMAT_ARGB32, w, h, stride);
+			auto tcr = create_context(part, draw, x0, y0);
+
+			for (auto &layer : layers) {
+				layer.draw(tcr, tile);
+			}
+
+			cairo_destroy(tcr);
+			cairo_surface_flush(part);
+			cairo_surface_destroy(part);
+		});
+
+		cairo_surface_mark_dirty(surface);
 	}
 
-	if (opts.draw_triangulation) 
+	draw_sites(trig, raster, surface);
+}
+
+void draw_trig(const char *file, const PDT &trig, const draw_options &draw)
+{
+	auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, draw.img_size, draw.img_size);
+	auto cr = create_context(surface, draw);
+	site_raster raster { draw };
+
+	paint_trig(trig, draw, raster, cr);
+
+	cairo_surface_write_to_png(surface, file);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+}
+
+struct frame_renderer::state
+{
+	PDT trig;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+	site_raster raster;
+
+	// Scratch space for update_region
+	struct region_face {
+		PDT::Face_handle face;
+		vec2 shift;
+	};
+
+	std::vector<PDT::Face_handle> conflicts;
+	std::vector<PDT::Face_handle> stack;
+	std::unordered_set<const void *> seen;
+	std::unordered_map<const void *, region_face> region;
+	std::unordered_map<const void *, vec2> sites;
+	std::vector<vec2> dots;
+
+	state(const draw_options &draw)
+		: trig { PDT::Iso_rectangle { 0, 0, 1, 1 } }
+		, raster { draw }
 	{
-		cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 1.0);
-		draw_triangles(trig, cr);
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, draw.img_size, draw.img_size);
+		cr = create_context(surface, draw);
+
+		cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+		cairo_paint(cr);
 	}
 
-	if (opts.draw_voronoi) 
+	~state()
 	{
-		cairo_set_source_rgba(cr, 1.0, 0.0, 0.0, 1.0);
-		draw_voronoi(trig, cr);
+		cairo_destroy(cr);
+		cairo_surface_destroy(surface);
+	}
+};
+
+frame_renderer::frame_renderer(const ivs_config &config)
+	: config { config }
+	, decorated { config.draw.draw_voronoi || config.draw.draw_triangulation || config.draw.draw_circumcircles }
+	, s { std::make_unique<state>(config.draw) }
+{
+}
+
+frame_renderer::~frame_renderer()
+{
+}
+
+void frame_renderer::add_point(uint32_t index, vec2 point, bool draw)
+{
+	if (decorated) {
+		update_region(point);
+	} else {
+		// Without decorations nothing that's already drawn ever changes, so
+		// just stamp the new dot on top. Doesn't even need the triangulation.
+		s->dots.assign(1, point);
+		s->raster.draw(s->surface, s->dots);
 	}
 
-	cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 1.0);
-	draw_sites(trig, cr);
+	bool last = index + 1 == config.point_count;
 
-	cairo_surface_write_to_png(surface, file);
-	cairo_destroy(cr);
-	cairo_surface_destroy(surface);
+	if (draw && (index % config.inter_stride == 0 || last)) {
+		std::vector<char> buf;
+
+		auto strsz = (size_t)snprintf(nullptr, 0, config.inter_format.c_str(), index);
+		buf.resize(strsz + 1, 0);
+
+		sprintf(buf.data(), config.inter_format.c_str(), index);
+
+		cairo_surface_write_to_png(s->surface, buf.data());
+	}
+}
+
+/**
+ * Insert a point and redraw the part of the image that changed. The things
+ * that change are the faces the point destroys and the ones it creates, so the
+ * dirty region is the bounding box of all of their disks. That region is
+ * cleared and everything that overlaps it is drawn again, clipped to it.
+ *
+ * "Everything that overlaps it" is every face whose disk overlaps it. Those
+ * faces are all connected to each other (for every point in the region, the
+ * faces whose disks contain it are a connected conflict zone, and the region
+ * itself is connected), so they're found with a flood fill from the new
+ * faces, instead of looking at all of them.
+ */
+void frame_renderer::update_region(vec2 point)
+{
+	const auto &draw = config.draw;
+	auto &trig = s->trig;
+	auto cr = s->cr;
+
+	double margin = (std::max<double>(draw.line_width, 2 * draw.point_size) + 2) / draw.img_size;
+
+	PDT::Point p { point.x, point.y };
+
+	if (trig.number_of_vertices() == 0) {
+		trig.insert(p);
+		paint_trig(trig, draw, s->raster, cr);
+		return;
+	}
+
+	rect dirty = rect::empty();
+
+	s->conflicts.clear();
+	trig.get_conflicts(p, std::back_inserter(s->conflicts));
+
+	for (auto face : s->conflicts) {
+		dirty.add(face_disk(trig, face, margin));
+	}
+
+	auto vertex = trig.insert(p);
+	auto fb = trig.incident_faces(vertex);
+	auto fc = fb;
+
+	do {
+		dirty.add(face_disk(trig, fc, margin));
+	} while (++fc != fb);
+
+	// Early on, the disks are huge and cover everything anyway
+	if (dirty.size().x >= 0.5 || dirty.size().y >= 0.5) {
+		paint_trig(trig, draw, s->raster, cr);
+		return;
+	}
+
+	// Line the region up with the pixels. That way the clip doesn't leave
+	// half painted pixels along the edges, and the dots (which don't go
+	// through Cairo) can be clipped to exactly the same pixels.
+	double size = draw.img_size;
+
+	dirty.min = glm::floor(dirty.min * size) / size;
+	dirty.max = glm::ceil(dirty.max * size) / size;
+
+	// Flood fill out from the new faces, remembering how far each face has to
+	// be moved to end up on top of the dirty region
+	auto &region = s->region;
+	auto &seen = s->seen;
+	auto &stack = s->stack;
+
+	region.clear();
+	seen.clear();
+	stack.clear();
+	stack.push_back(fc);
+
+	while (!stack.empty()) {
+		auto face = stack.back();
+		stack.pop_back();
+
+		if (!seen.insert(&*face).second) continue;
+
+		vec2 shift;
+
+		if (!torus_overlap(face_disk(trig, face, margin), dirty, shift)) continue;
+
+		region[&*face] = state::region_face { face, shift };
+
+		for (int i = 0; i < 3; i++) {
+			stack.push_back(face->neighbor(i));
+		}
+	}
+
+	// Every vertex of a face in the region, once
+	auto &sites = s->sites;
+	auto r = draw.point_size / draw.img_size;
+
+	sites.clear();
+
+	for (auto &[handle, rf] : region) {
+		for (int k = 0; k < 3; k++) {
+			auto v = rf.face->vertex(k);
+			vec2 site = ::point(trig, v);
+			vec2 shift;
+
+			if (torus_overlap(rect::around(site, r + margin), dirty, shift)) {
+				sites[&*v] = site + shift;
+			}
+		}
+	}
+
+	// The dirty region might stick out over the edge, so draw it once for
+	// every copy that's on the image
+	for (int ty = -1; ty <= 1; ty++) {
+		for (int tx = -1; tx <= 1; tx++) {
+			if (dirty.max.x + tx < 0 || dirty.min.x + tx > 1) continue;
+			if (dirty.max.y + ty < 0 || dirty.min.y + ty > 1) continue;
+
+			cairo_save(cr);
+			cairo_translate(cr, tx, ty);
+			cairo_rectangle(cr, dirty.min.x, dirty.min.y, dirty.size().x, dirty.size().y);
+			cairo_clip(cr);
+
+			cairo_set_source_rgba(cr, 1.0, 1.0, 1.0, 1.0);
+			cairo_paint(cr);
+
+			if (draw.draw_circumcircles) {
+				cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.3);
+				cairo_new_path(cr);
+
+				for (auto &[handle, rf] : region) {
+					vec2 v[3];
+					face_points(trig, rf.face, v);
+
+					vec2 c;
+					double r2;
+					circumcircle(v[0], v[1], v[2], c, r2);
+
+					auto radius = std::sqrt(r2);
+
+					c += rf.shift;
+
+					cairo_move_to(cr, c.x + radius, c.y);
+					cairo_arc(cr, c.x, c.y, radius, 0, TAU);
+				}
+
+				cairo_stroke(cr);
+			}
+
+			if (draw.draw_triangulation) {
+				cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 1.0);
+				cairo_new_path(cr);
+
+				for (auto &[handle, rf] : region) {
+					vec2 v[3];
+					face_points(trig, rf.face, v);
+
+					for (int k = 0; k < 3; k++) {
+						auto a = v[k] + rf.shift;
+						auto b = v[(k + 1) % 3] + rf.shift;
+
+						cairo_move_to(cr, a.x, a.y);
+						cairo_line_to(cr, b.x, b.y);
+					}
+				}
+
+				cairo_stroke(cr);
+			}
+
+			if (draw.draw_voronoi) {
+				cairo_set_source_rgba(cr, 1.0, 0.0, 0.0, 1.0);
+				cairo_new_path(cr);
+
+				for (auto &[handle, rf] : region) {
+					for (int i = 0; i < 3; i++) {
+						auto neighbor = rf.face->neighbor(i);
+
+						// Draw each edge once. If the neighbor isn't in the
+						// region, the part of the edge that's in the region
+						// is ours.
+						if (region.count(&*neighbor) && &*neighbor < handle) continue;
+
+						auto segment = trig.dual(PDT::Edge { rf.face, i });
+
+						vec2 a { segment.source().x(), segment.source().y() };
+						vec2 b { segment.target().x(), segment.target().y() };
+						vec2 shift;
+
+						if (!torus_overlap(rect { glm::min(a, b), glm::max(a, b) }, dirty, shift)) continue;
+
+						a += shift;
+						b += shift;
+
+						cairo_move_to(cr, a.x, a.y);
+						cairo_line_to(cr, b.x, b.y);
+					}
+				}
+
+				cairo_stroke(cr);
+			}
+
+			cairo_restore(cr);
+
+			auto &dots = s->dots;
+			dots.clear();
+
+			for (auto &[handle, site] : sites) {
+				dots.push_back(site + vec2 { (double)tx, (double)ty });
+			}
+
+			s->raster.draw(s->surface, dots,
+				(int32_t)std::lround((dirty.min.x + tx) * size),
+				(int32_t)std::lround((1 - dirty.max.y - ty) * size),
+				(int32_t)std::lround((dirty.max.x + tx) * size),
+				(int32_t)std::lround((1 - dirty.min.y - ty) * size));
+		}
+	}
 }
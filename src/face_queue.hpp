@@ -0,0 +1,246 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * The priority queue for the faces of the triangulation.
+ *
+ * This used to be a plain std::priority_queue, with the problem that you can't
+ * remove anything from the middle of it. So when a new point destroyed a bunch
+ * of faces, they just stayed in the queue until they were popped and found to
+ * be invalid. For big sets that meant the queue was mostly garbage.
+ *
+ * This is a regular d-ary max-heap, except that every face knows where in the
+ * heap it is (the "slot", stored in the face itself, see face_info in ivs.hpp).
+ * Every time an entry is moved around in the heap, the slot in the face is
+ * updated. That way we can find and remove a face in O(log n) when it gets
+ * destroyed, and the queue only ever contains faces that actually exist.
+ *
+ * Every entry also carries a "stamp", a number that's unique to that particular
+ * push, and the face stores the stamp of its latest push next to the slot. So
+ * checking whether an entry belongs to a face (and whether a face's slot is
+ * actually current) is a single integer compare. That's what lets clear() just
+ * drop everything without going around fixing up the faces. 
+ *
+ * The heap is templated on the entry type (which needs `face` and `stamp`
+ * members and an operator<) and on a type with `slot` and `stamp` functions
+ * returning the slot and stamp of a face. That one is stored in the heap, so it
+ * can point at whatever triangulation the faces live in.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+#include <limits>
+
+/**
+ * This structure is the thing that gets put into the priority queue. It used to
+ * keep all three points and vertex handles of the triangle around so that we
+ * could check if it was still a face, but these days the queue never contains
+ * dead faces, so all we need is the circumcircle (computed once, when the face
+ * is created), the face itself and the stamp (see face_heap below). Comes out at
+ * 40 bytes, down from 88 (32 with the compact engine, where a face is just an
+ * index).
+ *
+ * It's sorted on the squared radius of the circumcircle. Ties (which happen
+ * more often than you'd think, IVSs love making regular patterns) are broken
+ * on the center, so that which face comes out first doesn't depend on the
+ * order they were pushed in.
+ */
+template <typename Face>
+struct face_entry
+{
+	double r2;
+	vec2 center;
+	Face face;
+	uint32_t stamp;
+};
+
+/**
+ * Comparison function for the priority queue struct. 
+ */
+template <typename Face>
+inline bool operator<(const face_entry<Face> &e0, const face_entry<Face> &e1)
+{
+	if (e0.r2 != e1.r2) return e0.r2 < e1.r2;
+	if (e0.center.x != e1.center.x) return e0.center.x < e1.center.x;
+	return e0.center.y < e1.center.y;
+}
+
+template <typename Entry, typename Faces, uint32_t Arity = 4>
+class face_heap
+{
+public:
+	/**
+	 * Slot value for faces that aren't in the queue.
+	 */
+	static constexpr uint32_t NOT_QUEUED = std::numeric_limits<uint32_t>::max();
+
+	explicit face_heap(Faces faces = Faces {})
+		: faces { faces }
+	{
+	}
+
+	bool empty() const { return entries.empty(); }
+	size_t size() const { return entries.size(); }
+
+	/**
+	 * The largest entry in the queue.
+	 */
+	const Entry &top() const
+	{
+		return entries[0];
+	}
+
+	void push(const Entry &entry)
+	{
+		assert(entries.size() < NOT_QUEUED);
+
+		entries.push_back(entry);
+		sift_up(entries.size() - 1);
+	}
+
+	/**
+	 * Remove and return the largest entry in the queue.
+	 */
+	Entry pop()
+	{
+		Entry top = entries[0];
+
+		remove_at(0);
+
+		return top;
+	}
+
+	/**
+	 * Is this face in the queue?
+	 */
+	template <typename Face>
+	bool contains(const Face &face) const
+	{
+		auto slot = faces.slot(face);
+
+		return slot < entries.size() && entries[slot].stamp == faces.stamp(face);
+	}
+
+	/**
+	 * Remove the entry for a face from the queue. Does nothing if the face
+	 * isn't in it.
+	 */
+	template <typename Face>
+	void remove(const Face &face)
+	{
+		if (contains(face)) {
+			remove_at(faces.slot(face));
+		}
+	}
+
+	/**
+	 * Make room for n entries.
+	 */
+	void reserve(size_t n)
+	{
+		entries.reserve(n);
+	}
+
+	/**
+	 * Empty the queue. The slots in the faces are left as they are, but the
+	 * stamps won't match anything any more so they don't count.
+	 */
+	void clear()
+	{
+		entries.clear();
+	}
+
+private:
+	Faces faces;
+	std::vector<Entry> entries;
+
+	/**
+	 * Put an entry at position i in the heap, and tell its face about it.
+	 */
+	void place(size_t i, const Entry &entry)
+	{
+		entries[i] = entry;
+		faces.slot(entry.face) = (uint32_t)i;
+	}
+
+	void remove_at(size_t i)
+	{
+		faces.slot(entries[i].face) = NOT_QUEUED;
+
+		Entry last = entries.back();
+		entries.pop_back();
+
+		if (i < entries.size()) {
+			// Fill the hole with the last entry. It might be either bigger or
+			// smaller than whatever used to be there, so it might need to go
+			// up or down.
+			place(i, last);
+
+			if (i > 0 && entries[(i - 1) / Arity] < entries[i]) {
+				sift_up(i);
+			} else {
+				sift_down(i);
+			}
+		}
+	}
+
+	void sift_up(size_t i)
+	{
+		Entry entry = entries[i];
+
+		while (i > 0) {
+			size_t parent = (i - 1) / Arity;
+
+			if (!(entries[parent] < entry)) break;
+
+			place(i, entries[parent]);
+			i = parent;
+		}
+
+		place(i, entry);
+	}
+
+	void sift_down(size_t i)
+	{
+		Entry entry = entries[i];
+		size_t n = entries.size();
+
+		while (true) {
+			size_t first = i * Arity + 1;
+
+			if (first >= n) break;
+
+			size_t last = std::min(first + Arity, n);
+			size_t largest = first;
+
+			for (size_t c = first + 1; c < last; c++) {
+				if (entries[largest] < entries[c]) largest = c;
+			}
+
+			if (!(entry < entries[largest])) break;
+
+			place(i, entries[largest]);
+			i = largest;
+		}
+
+		place(i, entry);
+	}
+};
@@ -36,9 +36,11 @@
  * O(n^2) or whatever) for large number of points (and the goal is to create an
  * IVS with points in the millions). So what you actually want to do for step 2
  * is to use a priority queue that stores all the circumcircles in the
- * triangulation instead of looping through all of them. Triangles in the queue
- * might not be valid any more (because new points have come in and broke them
- * up), so you might have to pop a couple.
+ * triangulation instead of looping through all of them. When a new point comes
+ * in, it breaks up all the triangles whose circumcircles contain it, so before
+ * inserting a point we find those triangles and take them out of the queue
+ * (the queue is a special heap that supports that, see face_queue.hpp). That
+ * way the queue only ever contains triangles that actually exist.
  *
  * This works quite well: generating an IVS with a million points takes about
  * 2.5-3 minutes on my computer. In the original paper they say it took them
@@ -54,264 +56,1445 @@
  *
  * Because this switch happens pretty early (usually within a few dozen points),
  * we don't start using the priority queue until we've switched to single-sheet
- * mode. There's just no reason for it, and it complicates the logic. That does
- * mean however that there's an annoying if statement in the middle of the loop,
- * but c'est la vie. 
+ * mode. There's just no reason for it, and it complicates the logic. So the
+ * generator is split in two: run_nine_sheet, which just scans every face, and
+ * then the priority queue version for the rest of the points.
+ *
+ * The priority queue version comes in two flavours: one that keeps using CGAL's
+ * triangulation, and one that copies it over into compact_trig (see
+ * compact_trig.cpp) at the switch, which is a lot leaner. They produce exactly
+ * the same points, so the CGAL one is mostly around to check the other one
+ * against.
+ *
+ * Then there's the tiled engine, which gives up on exact for speed with really
+ * big sets: see run_tiled.
  */
-#include "main.hpp"
+#include "ivs.hpp"
+#include "compact_trig.hpp"
+#include "face_queue.hpp"
+#include "bucket_queue.hpp"
+#include "worker_pool.hpp"
+#include "pipeline.hpp"
+#include "circumcircle.hpp"
+#include "tile_refiner.hpp"
+
+#include <numeric>
+#include <stdexcept>
 
 /**
- * This structure is the thing that gets put into the priority queue. It
- * maintains the coordinates as well as the vertex handles for the points of the
- * triangle so that we can easily check if it's still valid. It's sorted on the
- * "size" field (which is the radius of the circumcircle of the three points).
+ * Where the priority queue keeps track of a face's position in it, for CGAL
+ * faces and for compact_trig faces.
  */
-struct tris
-{
-	vec2 p0;
-	vec2 p1;
-	vec2 p2;
-	PDT::Vertex_handle v0;
-	PDT::Vertex_handle v1;
-	PDT::Vertex_handle v2;
-	
-	double size;
+struct cgal_faces
+{
+	static uint32_t &slot(PDT::Face_handle face) { return face->info().slot; }
+	static uint32_t stamp(PDT::Face_handle face) { return face->info().stamp; }
+};
 
-	tris(){}
-	
-    tris(vec2 p0, vec2 p1, vec2 p2,
-        PDT::Vertex_handle v0,
-        PDT::Vertex_handle v1,
-        PDT::Vertex_handle v2)
-
-        : p0(p0), p1(p1), p2(p2)
-        , v0(v0), v1(v1), v2(v2)
-        , size(glm::length(circumcircle_center(p0, p1, p2) - p0))
-	{
-	}
+struct compact_faces
+{
+	compact_trig *trig;
+
+	uint32_t &slot(uint32_t face) const { return trig->info(face).slot; }
+	uint32_t stamp(uint32_t face) const { return trig->info(face).stamp; }
 };
 
+using cgal_entry = face_entry<PDT::Face_handle>;
+using cgal_queue = face_heap<cgal_entry, cgal_faces>;
+
+using compact_entry = face_entry<uint32_t>;
+using compact_queue = face_heap<compact_entry, compact_faces>;
+
+using cgal_bucket_queue = bucket_queue<cgal_entry, cgal_faces>;
+using compact_bucket_queue = bucket_queue<compact_entry, compact_faces>;
+
 /**
- * Comparison function for the priority queue struct. 
+ * The corners of a face, for computing its circumcircle.
+ *
+ * The offsets are shifted so that the smallest one is zero, same as
+ * compact_trig does. CGAL doesn't care which copy of the triangle it hands us,
+ * but the last bits of the circle do, and the two engines have to agree on
+ * those to produce the same set.
  */
-constexpr bool operator<(const tris &t0, const tris &t1)
+static void corners(const PDT &trig, PDT::Face_handle face, vec2 &p0, vec2 &p1, vec2 &p2)
+{
+	auto triangle = trig.periodic_triangle(face);
+
+	int mx = std::min({ triangle[0].second.x(), triangle[1].second.x(), triangle[2].second.x() });
+	int my = std::min({ triangle[0].second.y(), triangle[1].second.y(), triangle[2].second.y() });
+
+	for (auto &corner : triangle) {
+		corner.second = PDT::Offset { corner.second.x() - mx, corner.second.y() - my };
+	}
+
+	p0 = point(trig, triangle[0]);
+	p1 = point(trig, triangle[1]);
+	p2 = point(trig, triangle[2]);
+}
+
+static void corners(const compact_trig &trig, uint32_t face, vec2 &p0, vec2 &p1, vec2 &p2)
 {
-	return t0.size < t1.size;
+	trig.triangle(face, p0, p1, p2);
 }
 
 /**
- * Function used to log progress for debug purposes. Only logs at most once
- * every 16 ms, unless forced. 
+ * Where a face keeps the stamp of its latest queue entry.
  */
-static void log_progress(int curr, int total, bool force = false)
-{
-	using namespace std::chrono;
+static uint32_t &stamp_of(const PDT &, PDT::Face_handle face) { return face->info().stamp; }
+static uint32_t &stamp_of(compact_trig &trig, uint32_t face) { return trig.info(face).stamp; }
 
-    // I hate <chrono>
-	using duration = duration<double, std::milli>;
+/**
+ * Compute the circumcircles of a bunch of faces in one go (see
+ * circumcircle.hpp). Circle k in circles is the one of faces[k].
+ */
+template <typename Trig, typename Face>
+static void compute_circles(const Trig &trig, const std::vector<Face> &faces, circle_batch &circles)
+{
+	circles.clear();
 
-    // Have I mentioned I *hate* <chrono>
-	static time_point<steady_clock> last_logged { steady_clock::now() };
+	for (auto face : faces) {
+		vec2 p0, p1, p2;
+		corners(trig, face, p0, p1, p2);
+		circles.push(p0, p1, p2);
+	}
 
-	auto now = steady_clock::now();
+	circles.compute();
+}
 
-    // this library was written by psychopaths. Why am i doing this to myself?
-	if (force || duration_cast<duration>(now - last_logged).count() > 16.666)
-	{
-        // i don't know why i bother with iostream, i should just use fprintf
-		std::cerr << "\rPoint " << curr << "/" << total;
-		fprintf(stderr, " (%.2f%%)", 100.0 * (double)curr/(double)total);
-		last_logged = now;
+/**
+ * Hand out a fresh stamp. Stamps are 32 bit to keep the entries small. Each
+ * point pushes ~6 faces, so this gives out somewhere north of 700 million
+ * points, which is why generate_ivs stops at MAX_POINT_COUNT. If it runs out
+ * anyway, wrapping around would make dead queue entries look alive (0 is what
+ * the bucket queue stamps its empty spots with), so that's an error, even in
+ * release builds.
+ */
+static uint32_t next_stamp(uint32_t &last_stamp)
+{
+	if (last_stamp == std::numeric_limits<uint32_t>::max()) {
+		throw std::overflow_error("Ran out of queue stamps");
 	}
 
-    std::chrono::high_resolution_clock::now();
+	return ++last_stamp;
 }
 
 /**
- * Convenience function for adding a point to the triangulation, as well as
- * recording it's position for the output. 
+ * Push a bunch of faces onto the queue, each with a fresh stamp. The circles
+ * are computed in one batch, so hand it as many at once as you can.
  */
-static PDT::Vertex_handle add_point(PDT &trig, vec2 point)
+template <typename Trig, typename Queue, typename Face>
+static void enqueue_all(
+	Trig &trig,
+	Queue &pq,
+	uint32_t &last_stamp,
+	circle_batch &circles,
+	const std::vector<Face> &faces)
 {
-    if (opts.output) {
-        *opts.output << std::setprecision(16)
-                     << point.x << "," << point.y << std::endl;
-    }
+	compute_circles(trig, faces, circles);
+
+	for (size_t k = 0; k < faces.size(); k++) {
+		auto stamp = next_stamp(last_stamp);
 
-	return trig.insert(PDT::Point { point.x, point.y });
+		stamp_of(trig, faces[k]) = stamp;
+		pq.push(face_entry<Face> { circles.r2(k), circles.center(k), faces[k], stamp });
+	}
 }
 
 /**
- * Convenience function for drawing the intermediate triangulations. 
+ * Move a point into [0,1)x[0,1).
  */
-static void draw_inter(const PDT &trig, int i) {
-	if (opts.inter_format != "") {
-		std::vector<char> buf;
+static vec2 wrap(vec2 p)
+{
+	// This is a little bit silly, i could just use fract or whatever, but
+	// it used to be that the domain could be anything, not just [0,1). But
+	// this is robust and fast enough
+	while (p.x <  0) p.x += 1;
+	while (p.x >= 1) p.x -= 1;
+	while (p.y <  0) p.y += 1;
+	while (p.y >= 1) p.y -= 1;
 
-		auto strsz = (size_t)snprintf(nullptr, 0, opts.inter_format.c_str(), i);
-		buf.resize(strsz + 1, 0);
+	assert(p.x >= 0);
+	assert(p.x <  1);
+	assert(p.y >= 0);
+	assert(p.y <  1);
 
-		sprintf(buf.data(), opts.inter_format.c_str(), i);
+	return p;
+}
+
+/**
+ * Does anything want the final triangulation? The compact and tiled engines
+ * don't keep a CGAL one up to date, so they only build one at the end if so.
+ */
+static bool wants_final_trig(const ivs_config &config)
+{
+	return config.final_name != "" || config.final_trig;
+}
 
-		draw_trig(buf.data(), trig);
+bool parse_engine(const std::string &name, ivs_engine &engine)
+{
+	if (name == "cgal") {
+		engine = ivs_engine::cgal;
+	} else if (name == "compact") {
+		engine = ivs_engine::compact;
+	} else if (name == "tiled") {
+		engine = ivs_engine::tiled;
+	} else {
+		return false;
 	}
+
+	return true;
+}
+
+const char *engine_name(ivs_engine engine)
+{
+	switch (engine) {
+	case ivs_engine::cgal:    return "cgal";
+	case ivs_engine::compact: return "compact";
+	case ivs_engine::tiled:   return "tiled";
+	}
+
+	return "unknown";
+}
+
+bool parse_queue(const std::string &name, ivs_queue &queue)
+{
+	if (name == "heap") {
+		queue = ivs_queue::heap;
+	} else if (name == "bucket") {
+		queue = ivs_queue::bucket;
+	} else {
+		return false;
+	}
+
+	return true;
 }
 
 /**
- * Main procedure for the algorithm.
+ * Used to log progress for debug purposes. Only logs at most once every 16 ms,
+ * unless forced. This used to be a function with a static in it, but that
+ * doesn't fly when there might be several generators running at once.
+ *
+ * It's called for every point, and reading the clock that often shows up in
+ * profiles, so it only looks at the clock every CHECK_INTERVAL calls.
  */
-void generate_ivs(const std::vector<vec2> &seeds)
+struct progress_log
 {
-	PDT trig { PDT::Iso_rectangle { 0, 0, 1, 1 } };
+	static const uint32_t CHECK_INTERVAL = 256;
 
-	std::priority_queue<tris> pq;
+	std::chrono::time_point<std::chrono::steady_clock> last_logged;
+	uint32_t calls;
+	bool enabled;
 
-    // Add the seeds
-	for (uint32_t i = 0; i < seeds.size(); i++) {
-		add_point(trig, seeds[i]);
-		draw_inter(trig, i);
+	progress_log(bool enabled)
+		: last_logged { }
+		, calls { 0 }
+		, enabled { enabled }
+	{
+		if (enabled) last_logged = std::chrono::steady_clock::now();
 	}
 
-    // Are we in one-sheet mode or nine-sheet mode?
-	bool one_sheet = false;
+	void log(int curr, int total, bool force = false)
+	{
+		using namespace std::chrono;
 
-	for (uint32_t i = seeds.size(); i < opts.point_count; i++) {
-		vec2 new_point;
-		
-		if (one_sheet) {
-            assert(pq.size() > 0 && "Priority queue should not be empty");
+		if (!enabled) return;
+		if (!force && ++calls < CHECK_INTERVAL) return;
 
-			tris t;
-			bool is_face = false;
+		calls = 0;
 
-			do {
-				t = pq.top();
-				pq.pop();
+		// I hate <chrono>
+		using duration = duration<double, std::milli>;
 
-				// Adding new points will split up the triangles, so have this
-				// check here to make sure that whatever was popped of the
-				// priority queue is still a valid face.
-				is_face = trig.is_face(t.v0, t.v1, t.v2);
-			} while(pq.size() > 0 && !is_face);
+		auto now = steady_clock::now();
 
-            assert(is_face > 0);
+		// this library was written by psychopaths. Why am i doing this to myself?
+		if (force || duration_cast<duration>(now - last_logged).count() > 16.666)
+		{
+			// i don't know why i bother with iostream, i should just use fprintf
+			std::cerr << "\rPoint " << curr << "/" << total;
+			fprintf(stderr, " (%.2f%%)", 100.0 * (double)curr/(double)total);
+			last_logged = now;
+		}
+	}
+};
+
+/**
+ * Adds the time between construction and destruction to a counter in
+ * ivs_stats. Does nothing (not even reading the clock) if the counter is null,
+ * which is the case when nobody asked for stats.
+ */
+struct phase_timer
+{
+	double *counter;
+	std::chrono::time_point<std::chrono::steady_clock> start;
+
+	phase_timer(double *counter) : counter(counter)
+	{
+		if (counter) start = std::chrono::steady_clock::now();
+	}
+
+	~phase_timer()
+	{
+		using namespace std::chrono;
+
+		if (counter) {
+			*counter += duration<double>(steady_clock::now() - start).count();
+		}
+	}
+};
+
+/**
+ * The stats to record into, or null. Always null if stats are compiled out
+ * (see IVS_STATS), and since it's inlined, the compiler throws away everything
+ * that checks it.
+ */
+static inline ivs_stats *stats_of(const ivs_config &config)
+{
+#if IVS_STATS
+	return config.stats;
+#else
+	(void)config;
+	return nullptr;
+#endif
+}
+
+/**
+ * Returns a pointer to one of the timing fields in stats, or null if there
+ * aren't any stats. Use it like phase(stats, &ivs_stats::insert).
+ */
+static double *phase(ivs_stats *stats, double ivs_stats::*field)
+{
+	return stats ? &(stats->*field) : nullptr;
+}
+
+/**
+ * The memory in an ivs_workspace. The compact queues point at the compact
+ * triangulation, so this can't be moved, but it never needs to be.
+ */
+struct ivs_workspace::buffers
+{
+	cgal_queue cgal_pq;
+	cgal_bucket_queue cgal_bucket_pq;
+	std::vector<PDT::Face_handle> conflicts;
+
+	compact_trig compact;
+	compact_queue compact_pq { compact_faces { &compact } };
+	compact_bucket_queue compact_bucket_pq { compact_faces { &compact } };
+	compact_trig::conflict_zone zone;
+	std::vector<uint32_t> created;
+
+	// Faces and their circumcircles on their way into the queue
+	std::vector<PDT::Face_handle> faces;
+	circle_batch circles;
+};
 
-			new_point = circumcircle_center(t.p0, t.p1, t.p2);
+ivs_workspace::ivs_workspace()
+	: b { std::make_unique<buffers>() }
+{
+}
+
+ivs_workspace::~ivs_workspace()
+{
+}
+
+/**
+ * The state of one run of the generator that every part of it needs.
+ */
+struct ivs_run
+{
+	const ivs_config &config;
+	ivs_stats *stats;
+	progress_log progress;
+	uint32_t last_stamp;
+
+	// The callback, plus the snapshots if there are any
+	point_callback callback;
+
+	// The stats for each snapshot, recorded on the generator thread when the
+	// last point of it is handed over, and the next one to record and to
+	// hand out
+	std::chrono::steady_clock::time_point start;
+	std::vector<ivs_stats> snapshot_stats;
+	size_t next_recorded;
+	size_t next_snapshot;
+
+	// If the output and frames are handled on other threads (config.async)
+	std::unique_ptr<point_pipeline> pipeline;
+
+	// Otherwise, if there are any frames to draw
+	std::unique_ptr<frame_renderer> frames;
+
+	// The queues and scratch space, from config.workspace if there is one
+	std::unique_ptr<ivs_workspace::buffers> own_buffers;
+	ivs_workspace::buffers *buffers;
+
+	ivs_run(const ivs_config &config, const point_callback &output)
+		: config { config }
+		, stats { stats_of(config) }
+		, progress { config.log_progress }
+		, last_stamp { 0 }
+		, callback { output }
+		, start { std::chrono::steady_clock::now() }
+		, next_recorded { 0 }
+		, next_snapshot { 0 }
+	{
+		if (config.snapshot && !config.emit_at.empty()) {
+			snapshot_stats.resize(config.emit_at.size());
+
+			// Snapshots go wherever the callback goes, right after it, so
+			// that all of their points have been through it
+			callback = [this, output](uint32_t index, vec2 point) {
+				if (output) {
+					output(index, point);
+				}
+
+				take_snapshot(index);
+			};
+		}
+
+		if (config.workspace) {
+			buffers = config.workspace->b.get();
 		} else {
-			auto fb = trig.faces_begin();
-			auto fe = trig.faces_end();
+			own_buffers = std::make_unique<ivs_workspace::buffers>();
+			buffers = own_buffers.get();
+		}
+
+		if (config.async && (callback || config.inter_format != "")) {
+			pipeline = std::make_unique<point_pipeline>(config, callback);
+		} else if (config.inter_format != "") {
+			frames = std::make_unique<frame_renderer>(config);
+		}
+	}
+
+	/**
+	 * Hand a new point to the output, either directly or through the
+	 * pipeline. draw says whether there should be a frame for it (if frames
+	 * are being drawn at all).
+	 */
+	void emit(uint32_t index, vec2 point, bool draw = true)
+	{
+		phase_timer timer { phase(stats, &ivs_stats::output) };
+
+		if (next_recorded < snapshot_stats.size() && index + 1 == config.emit_at[next_recorded]) {
+			record_snapshot();
+		}
+
+		if (pipeline) {
+			pipeline->publish(index, point, draw);
+			return;
+		}
 
-			double largest = 0;
+		if (callback) {
+			callback(index, point);
+		}
+
+		if (frames) {
+			frames->add_point(index, point, draw);
+		}
+	}
+
+	/**
+	 * Copy the stats for the next snapshot. Called on the generator thread,
+	 * before the snapshot's last point is handed over, so the copy is there
+	 * by the time take_snapshot gets to it.
+	 */
+	void record_snapshot()
+	{
+		if (stats) {
+			auto &s = snapshot_stats[next_recorded];
+
+			s = *stats;
+			s.total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			s.peak_rss = peak_rss();
+		}
+
+		next_recorded++;
+	}
+
+	/**
+	 * Hand out the next snapshot if point index was the last one of it.
+	 * Called on the callback's thread, right after the callback.
+	 */
+	void take_snapshot(uint32_t index)
+	{
+		if (next_snapshot < snapshot_stats.size() && index + 1 == config.emit_at[next_snapshot]) {
+			config.snapshot(index + 1, stats ? &snapshot_stats[next_snapshot] : nullptr);
+			next_snapshot++;
+		}
+	}
+};
+
+/**
+ * Convenience function for adding a point to the triangulation, as well as
+ * handing it to the output. 
+ *
+ * If we know a face that the point is in conflict with (which we always do in
+ * the main loop: the point is the circumcenter of the face we just popped), pass
+ * it in as the hint. Without it, CGAL has to find where the point goes by
+ * walking there from some arbitrary face, which for millions of points is a
+ * pretty long walk. With it, the walk is a step or two.
+ */
+static PDT::Vertex_handle add_point(
+	ivs_run &run,
+	PDT &trig,
+	uint32_t index,
+	vec2 point,
+	PDT::Face_handle hint = PDT::Face_handle())
+{
+	run.emit(index, point);
+
+	phase_timer timer { phase(stats_of(run.config), &ivs_stats::insert) };
+	return trig.insert(PDT::Point { point.x, point.y }, hint);
+}
+
+std::vector<vec2> make_seeds(uint32_t rng_seed, uint32_t seed_count)
+{
+	std::mt19937 engine { rng_seed } ;
+	std::uniform_real_distribution dist;
+
+	std::vector<vec2> seeds(seed_count);
+	
+	for (uint32_t i = 0; i < seed_count; i++)
+	{
+		seeds[i] = { dist(engine), dist(engine) };
+	}
 
-            // In nine-sheet mode, we just loop through the triangles to find
-            // the largest circumcircle. 
-			for (auto it = fb; it != fe; it++) {
-				auto triangle = trig.periodic_triangle(it);
+	return seeds;
+}
 
-				auto p0 = point(trig, triangle[0]);
-				auto p1 = point(trig, triangle[1]);
-				auto p2 = point(trig, triangle[2]);
+std::vector<vec2> generate_ivs(const ivs_config &config)
+{
+	std::vector<vec2> points;
+	points.reserve(config.point_count);
 
-				auto c = circumcircle_center(p0, p1, p2);
-				auto curr = glm::length(c - p0);
+	generate_ivs(config, [&](uint32_t, vec2 point) {
+		points.push_back(point);
+	});
 
-				if (curr > largest) {
+	return points;
+}
+
+/**
+ * Generate points from index i while the triangulation is in nine-sheet mode.
+ * Returns the index of the next point to generate once it has switched to
+ * one-sheet mode (or the point count, if it never got there).
+ */
+static uint32_t run_nine_sheet(ivs_run &run, PDT &trig, uint32_t i)
+{
+	auto stats = stats_of(run.config);
+
+	for (; i < run.config.point_count; i++) {
+		vec2 new_point;
+
+		{
+			phase_timer timer { phase(stats, &ivs_stats::nine_sheet_scan) };
+
+			auto &faces = run.buffers->faces;
+			auto &circles = run.buffers->circles;
+
+			faces.clear();
+
+			for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+				faces.push_back(it);
+			}
+
+			compute_circles(trig, faces, circles);
+
+			cgal_entry largest { 0, vec2 { 0, 0 }, PDT::Face_handle(), 0 };
+
+			// In nine-sheet mode, we just loop through the triangles to find
+			// the largest circumcircle. Uses the same ordering as the queue so
+			// that it doesn't matter what order CGAL gives us the faces in.
+			for (size_t k = 0; k < faces.size(); k++) {
+				cgal_entry curr { circles.r2(k), circles.center(k), faces[k], 0 };
+
+				if (largest < curr) {
 					largest = curr;
-					new_point = c;
 				}
 			}
 
-            assert(largest > 0);
-		}
+			assert(largest.r2 > 0);
 
+			new_point = wrap(largest.center);
+		}
 
-		// This is a little bit silly, i could just use fract or whatever, but
-		// it used to be that the domain could be anything, not just [0,1). But
-		// this is robust and fast enough
-		while (new_point.x <  0) new_point.x += 1;
-		while (new_point.x >= 1) new_point.x -= 1;
-		while (new_point.y <  0) new_point.y += 1;
-		while (new_point.y >= 1) new_point.y -= 1;
+		// No hint here: the face we found might be in one of the other sheets.
+		add_point(run, trig, i, new_point);
 
-		assert(new_point.x >= 0);
-		assert(new_point.x <  1);
-		assert(new_point.y >= 0);
-		assert(new_point.y <  1);
+		run.progress.log(i, run.config.point_count);
 
-        // This insert here might trigger the switch from nine-sheet to
-        // one-sheet, so we have to deal with that switch in the next section.
-        // If we're in one-sheet mode, inserting this point means we need to add
-        // the newly created triangles to the priority queue.  
-		auto inserted = add_point(trig, new_point);
 		auto sheets = trig.number_of_sheets();
 
-		if (one_sheet && sheets[0]*sheets[1] != 1) {
+		if (sheets[0]*sheets[1] == 1) {
+			if (stats) stats->one_sheet_switch = i;
 
-            // We get here if we've switched from one-sheet to nine-sheet. I
-            // don't think this ever happens, I think it only ever goes the
-            // other way. But if it does happen, this takes care of it:
-            // essentially we just clear the priority queue so that we have to
-            // fill it manually when it switches back to one-sheet.
+			return i + 1;
+		}
+	}
 
-			one_sheet = false;
-			pq = std::priority_queue<tris>{};
+	return i;
+}
 
-		} else if (!one_sheet && sheets[0]*sheets[1] == 1) {
+/**
+ * Generate points from index i in one-sheet mode, using the CGAL triangulation
+ * and the priority queue. Returns the index of the next point if the
+ * triangulation switches back to nine-sheet mode, which I don't think ever
+ * happens, but if it does, the priority queue is just emptied and gets filled
+ * again when it switches back.
+ *
+ * The queue is either a cgal_queue or a cgal_bucket_queue (see config.queue),
+ * they work the same.
+ */
+template <typename Queue>
+static uint32_t run_cgal(ivs_run &run, PDT &trig, Queue &pq, uint32_t i)
+{
+	auto stats = stats_of(run.config);
 
-            // We get here if we've just switched from nine-sheet to one-sheet.
-            // When that happens, loop through all triangles and add them all to
-            // the priority queue. 
-			one_sheet = true;
+	// Scratch space for the faces a new point is in conflict with, and the
+	// ones it creates
+	auto &conflicts = run.buffers->conflicts;
+	auto &created = run.buffers->faces;
+	auto &circles = run.buffers->circles;
 
-			auto fb = trig.faces_begin();
-			auto fe = trig.faces_end();
+	{
+		// Loop through all triangles and add them all to the priority queue.
+		phase_timer timer { phase(stats, &ivs_stats::bulk_fill) };
+
+		// Whatever's in there is from an earlier run (or an earlier stint in
+		// one-sheet mode), and doesn't count any more
+		pq.clear();
+		pq.reserve(2 * (size_t)run.config.point_count);
+
+		created.clear();
+
+		for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+			created.push_back(it);
+		}
+
+		enqueue_all(trig, pq, run.last_stamp, circles, created);
+	}
 
-			for (auto it = fb; it != fe; it++) {
-				auto triangle = trig.periodic_triangle(it);
+	for (; i < run.config.point_count; i++) {
+		assert(pq.size() > 0 && "Priority queue should not be empty");
 
-				auto p0 = point(trig, triangle[0]);
-				auto p1 = point(trig, triangle[1]);
-				auto p2 = point(trig, triangle[2]);
+		cgal_entry top;
 
-				pq.emplace(p0, p1, p2, it->vertex(0), it->vertex(1), it->vertex(2));
+		{
+			phase_timer timer { phase(stats, &ivs_stats::pop) };
+
+			// Faces get removed from the queue as soon as they're destroyed,
+			// so whatever is on top is always a valid face.
+			top = pq.pop();
+
+			assert(top.face->info().stamp == top.stamp);
+
+			if (stats) stats->pops++;
+		}
+
+		auto new_point = wrap(top.center);
+
+		{
+			// Inserting the point is going to destroy every face whose
+			// circumcircle contains it (the "conflict zone"), so find them and
+			// take them out of the queue before that happens. The popped face
+			// is in the conflict zone by definition, so we start from there.
+			phase_timer timer { phase(stats, &ivs_stats::remove) };
+
+			conflicts.clear();
+			trig.get_conflicts(
+				PDT::Point { new_point.x, new_point.y },
+				std::back_inserter(conflicts),
+				top.face);
+
+			for (auto face : conflicts) {
+				pq.remove(face);
 			}
 
-		} else if (one_sheet) {
+			if (stats) stats->removed_faces += conflicts.size();
+		}
+
+		// The popped face is also the best possible hint for where the point
+		// goes.
+		auto inserted = add_point(run, trig, i, new_point, top.face);
+		auto sheets = trig.number_of_sheets();
+
+		if (sheets[0]*sheets[1] != 1) {
+			run.progress.log(i, run.config.point_count);
+
+			return i + 1;
+		}
+
+		{
+			// Some number of new triangles have been created as a result of
+			// inserting the point. Those triangles need to be added to the
+			// priority queue. 
+			phase_timer timer { phase(stats, &ivs_stats::enqueue) };
 
-            // If we're in one-sheet mode, some number of new triangles have
-            // been created as a result of inserting the point. Those triangles
-            // need to be added to the priority queue. 
 			auto fb = trig.incident_faces(inserted);
 			auto it = fb;
 
-            // An interesting thing to note: adding a point iteratively to a
-            // Delaunay triangulation can create any number of new triangles and
-            // lead to all sorts of flipping in the structure, but all newly
-            // created triangles will have the inserted point as a vertex. So it
-            // is safe to just loop through the incident triangles of point and
-            // add them, we don't need to do anything else. 
-			do {
-				auto triangle = trig.periodic_triangle(it);
-				auto p0 = point(trig, triangle[0]);
-				auto p1 = point(trig, triangle[1]);
-				auto p2 = point(trig, triangle[2]);
+			// An interesting thing to note: adding a point iteratively to a
+			// Delaunay triangulation can create any number of new triangles and
+			// lead to all sorts of flipping in the structure, but all newly
+			// created triangles will have the inserted point as a vertex. So it
+			// is safe to just loop through the incident triangles of point and
+			// add them, we don't need to do anything else. 
+			created.clear();
 
-				pq.emplace(p0, p1, p2, it->vertex(0), it->vertex(1), it->vertex(2));
+			do {
+				created.push_back(it);
 			} while (++it != fb);
 
+			enqueue_all(trig, pq, run.last_stamp, circles, created);
+
+			if (stats) stats->created_faces += created.size();
+		}
+
+		if (stats) {
+			stats->queued_points++;
+			stats->queue_size_sum += pq.size();
+			stats->queue_high_water = std::max<uint64_t>(stats->queue_high_water, pq.size());
+		}
+
+		run.progress.log(i, run.config.point_count);
+	}
+
+	return i;
+}
+
+/**
+ * Insert the point of a conflict zone into a compact_trig: take the faces it
+ * destroys out of the queue, hand the point to the callback, insert it and
+ * queue up the faces it creates. The zone has to be up to date. 
+ */
+template <typename Queue>
+static void commit(
+	ivs_run &run,
+	compact_trig &trig,
+	Queue &pq,
+	const compact_trig::conflict_zone &zone,
+	std::vector<uint32_t> &created,
+	uint32_t i)
+{
+	auto stats = stats_of(run.config);
+
+	{
+		phase_timer timer { phase(stats, &ivs_stats::remove) };
+
+		for (auto face : zone.faces) {
+			pq.remove(face);
+		}
+
+		if (stats) stats->removed_faces += zone.faces.size();
+	}
+
+	run.emit(i, zone.point);
+
+	{
+		phase_timer timer { phase(stats, &ivs_stats::insert) };
+		trig.insert(zone, created);
+	}
+
+	{
+		// Every face created by the insertion is one we get handed back
+		// here, so there's no need to go looking for them.
+		phase_timer timer { phase(stats, &ivs_stats::enqueue) };
+
+		enqueue_all(trig, pq, run.last_stamp, run.buffers->circles, created);
+	}
+
+	if (stats) {
+		stats->queued_points++;
+		stats->created_faces += created.size();
+		stats->queue_size_sum += pq.size();
+		stats->queue_high_water = std::max<uint64_t>(stats->queue_high_water, pq.size());
+	}
+
+	run.progress.log(i, run.config.point_count);
+}
+
+/**
+ * How many candidates per thread run_speculative looks at in one go.
+ */
+static const size_t SPECULATION_WINDOW = 64;
+
+/**
+ * The multithreaded version of the compact loop.
+ *
+ * Once the set is big enough, the top few hundred entries in the queue are
+ * spread out all over the torus, and the points they'd insert almost never
+ * have anything to do with each other. So instead of popping one entry at a
+ * time, this pops a whole window of them and finds all their conflict zones in
+ * parallel (finding the zone is the part that actually walks around the
+ * triangulation, and it doesn't modify anything). Then the points are
+ * inserted one at a time, in order, exactly like the serial loop would:
+ *
+ *  - If a candidate's face was destroyed by an earlier point in the window,
+ *    the serial loop would have taken it out of the queue, so it's skipped.
+ *
+ *  - If a face created by an earlier point in the window has a bigger circle
+ *    than the candidate, the serial loop would have picked that one first, so
+ *    the rest of the window goes back in the queue and we start over.
+ *
+ *  - If an earlier point in the window changed any of the faces the zone was
+ *    made from (or any of the faces just outside it), the zone might be wrong,
+ *    so it's computed again. That's the only serial fallback, and it's rare.
+ *
+ * So the output is exactly the same as the serial loop, point for point.
+ */
+template <typename Queue>
+static uint32_t run_speculative(ivs_run &run, compact_trig &trig, Queue &pq, uint32_t i)
+{
+	auto stats = stats_of(run.config);
+
+	worker_pool pool { run.config.threads };
+
+	std::vector<compact_entry> candidates;
+	std::vector<compact_trig::conflict_zone> zones;
+	std::vector<uint32_t> created;
+
+	// The last window that changed each face
+	std::vector<uint32_t> touched;
+	uint32_t window_id = 0;
+
+	auto is_touched = [&](const compact_trig::conflict_zone &zone) {
+		for (auto face : zone.faces) {
+			if (touched[face] == window_id) return true;
+		}
+
+		for (auto face : zone.outside) {
+			if (touched[face] == window_id) return true;
+		}
+
+		return false;
+	};
+
+	auto touch = [&](const std::vector<uint32_t> &faces) {
+		for (auto face : faces) {
+			touched[face] = window_id;
+		}
+	};
+
+	while (i < run.config.point_count) {
+		window_id++;
+		touched.resize(trig.number_of_faces() + 2 * SPECULATION_WINDOW * pool.size(), 0);
+
+		// Early on the whole triangulation is a handful of faces, so there's
+		// no point in looking far ahead.
+		size_t window = std::min({
+			SPECULATION_WINDOW * pool.size(),
+			(size_t)(run.config.point_count - i),
+			trig.number_of_faces() / 16 + 1 });
+
+		{
+			phase_timer timer { phase(stats, &ivs_stats::pop) };
+
+			candidates.clear();
+
+			while (candidates.size() < window && !pq.empty()) {
+				candidates.push_back(pq.pop());
+			}
+
+			if (stats) stats->pops += candidates.size();
+		}
+
+		assert(candidates.size() > 0 && "Priority queue should not be empty");
+
+		if (zones.size() < candidates.size()) {
+			zones.resize(candidates.size());
+		}
+
+		{
+			phase_timer timer { phase(stats, &ivs_stats::remove) };
+
+			pool.parallel_for(candidates.size(), [&](size_t j) {
+				auto &c = candidates[j];
+				trig.find_conflicts(c.center, wrap(c.center), c.face, zones[j]);
+			});
+		}
+
+		size_t j = 0;
+
+		for (; j < candidates.size(); j++) {
+			auto &c = candidates[j];
+
+			if (trig.info(c.face).stamp != c.stamp) {
+				if (stats) stats->stale_pops++;
+				continue;
+			}
+			if (!pq.empty() && c < pq.top()) break;
+
+			auto &zone = zones[j];
+
+			if (is_touched(zone)) {
+				phase_timer timer { phase(stats, &ivs_stats::remove) };
+
+				trig.find_conflicts(c.center, wrap(c.center), c.face, zone);
+
+				if (stats) stats->speculation_misses++;
+			}
+
+			commit(run, trig, pq, zone, created, i++);
+
+			touch(zone.faces);
+			touch(zone.outside);
+			touch(created);
+		}
+
+		// Whatever didn't get its turn goes back in the queue
+		for (; j < candidates.size(); j++) {
+			auto &c = candidates[j];
+
+			if (trig.info(c.face).stamp == c.stamp) {
+				pq.push(c);
+			}
+		}
+	}
+
+	return i;
+}
+
+/**
+ * Same as run_cgal, but with compact_trig. The CGAL triangulation is copied
+ * into it and then emptied, so that we don't keep two of them around. Since
+ * compact_trig can't draw itself, a new CGAL triangulation is built from its
+ * points at the end if there's a final image to draw, and left in trig. (The
+ * intermediate frames don't need it, frame_renderer has its own.)
+ *
+ * With more than one thread, the actual work is done by run_speculative.
+ */
+template <typename Queue>
+static uint32_t run_compact(ivs_run &run, PDT &trig, Queue &pq, uint32_t i)
+{
+	auto stats = stats_of(run.config);
+
+	auto &compact = run.buffers->compact;
+
+	auto &zone = run.buffers->zone;
+	auto &created = run.buffers->created;
+
+	{
+		phase_timer timer { phase(stats, &ivs_stats::bulk_fill) };
+
+		// Make room for everything up front. With a workspace that's already
+		// been through a run this size, these don't allocate anything.
+		compact.reserve(run.config.point_count);
+		compact.assign(trig);
+		trig.clear();
+
+		pq.clear();
+		pq.reserve(2 * (size_t)run.config.point_count);
+
+		created.resize(compact.number_of_faces());
+		std::iota(created.begin(), created.end(), 0);
+
+		enqueue_all(compact, pq, run.last_stamp, run.buffers->circles, created);
+	}
+
+	if (run.config.threads != 1) {
+		i = run_speculative(run, compact, pq, i);
+	}
+
+	for (; i < run.config.point_count; i++) {
+		assert(pq.size() > 0 && "Priority queue should not be empty");
+
+		compact_entry top;
+
+		{
+			phase_timer timer { phase(stats, &ivs_stats::pop) };
+
+			top = pq.pop();
+
+			assert(compact.info(top.face).stamp == top.stamp);
+
+			if (stats) stats->pops++;
+		}
+
+		{
+			phase_timer timer { phase(stats, &ivs_stats::remove) };
+			compact.find_conflicts(top.center, wrap(top.center), top.face, zone);
+		}
+
+		commit(run, compact, pq, zone, created, i);
+	}
+
+	if (wants_final_trig(run.config)) {
+		trig = compact.to_pdt();
+	}
+
+	return i;
+}
+
+static bool is_one_sheet(const PDT &trig)
+{
+	auto sheets = trig.number_of_sheets();
+	return sheets[0]*sheets[1] == 1;
+}
+
+/**
+ * Put the points of an earlier run back into the triangulation. Since the
+ * triangulation of a set of points doesn't depend on the order they were
+ * inserted in, they can all go in with CGAL's range insert, which spatially
+ * sorts them first and is way faster than inserting them one at a time. The
+ * queue gets rebuilt from the faces when the one-sheet part starts, and since
+ * the circumcircles don't depend on anything but the faces, generation
+ * continues exactly like the original run would have. Returns the index of the
+ * next point.
+ */
+static uint32_t resume(ivs_run &run, PDT &trig)
+{
+	auto stats = stats_of(run.config);
+	auto count = (uint32_t)std::min<size_t>(run.config.resume.size(), run.config.point_count);
+
+	auto begin = run.config.resume.begin();
+	auto end = begin + count;
+
+	// Only the last one gets a frame
+	for (uint32_t i = 0; i < count; i++) {
+		run.emit(i, begin[i], i + 1 == count);
+	}
+
+	{
+		phase_timer timer { phase(stats, &ivs_stats::insert) };
+
+		std::vector<PDT::Point> points;
+		points.reserve(count);
+
+		for (auto it = begin; it != end; it++) {
+			points.emplace_back(it->x, it->y);
+		}
+
+		trig.insert(points.begin(), points.end(), true);
+	}
+
+	run.progress.log(count, run.config.point_count);
+
+	return count;
+}
+
+/**
+ * Exact points per tile that the tiled engine starts from.
+ */
+static const uint32_t TILED_PREFIX_PER_TILE = 1024;
+
+/**
+ * How much the radius the tiled engine refines down to shrinks every round.
+ */
+static const double TILED_ROUND_SHRINK = 0.9;
+
+/**
+ * The tiled engine. However fast the exact loop gets, it's one point at a
+ * time, on one core. For sets with hundreds of millions of points, that's a
+ * long wait, and nobody is going to notice if the order is a tiny bit off. So
+ * this trades exactness for threads:
+ *
+ *  1. The first TILED_PREFIX_PER_TILE points per tile are generated exactly,
+ *     with the compact engine.
+ *
+ *  2. The torus is split into config.tiles x config.tiles squares, and each
+ *     gets its own triangulation of the points in and around it, and its own
+ *     queue of the faces with their centers in it (see tile_refiner.hpp). The
+ *     halo around a square is twice as wide as the largest circle left after
+ *     the prefix, so that the faces in the queue are the exact faces of the
+ *     whole set.
+ *
+ *  3. Then it goes in rounds, each one with a threshold a bit smaller than the
+ *     last. In a round, each tile generates points, biggest circle first,
+ *     until its circles are all smaller than the threshold. The tiles are
+ *     colored like a checkerboard with four colors (which is why there has to
+ *     be an even number of them), and the tiles of one color all run at once:
+ *     they are never next to each other, so they can't get in each other's
+ *     way. After each color, the tiles around them get the new points, so the
+ *     next color knows about them.
+ *
+ *  4. At the end of the round, the new points of all the tiles are sorted on
+ *     the radius of the circle they were the center of, which is the order
+ *     the exact engine would have put them in if it had made the same points.
+ *
+ * Every point still goes in at the center of an empty circle, and the rounds
+ * go by radius, so the result is very close to exact. What's off is the order
+ * within a round: a point's circle can have a corner that another tile made
+ * earlier in the round, but with a smaller circle, which ends up after it in
+ * the output. Those are counted in ivs_stats::order_inversions, and ivs_bench
+ * measures the difference to the exact set (see measure_quality).
+ *
+ * The points depend on the number of tiles, but not on the number of threads.
+ * Returns the index of the next point, which is the point count, unless the
+ * tiles are too small for the circles of the prefix. Then it gives up after the
+ * prefix, and the rest is generated exactly.
+ */
+static uint32_t run_tiled(ivs_run &run, PDT &trig)
+{
+	const auto &config = run.config;
+	auto stats = stats_of(config);
+
+	auto n = config.point_count;
+	auto side = config.tiles;
+	auto tile_count = side * side;
+
+	assert(side >= 2 && side % 2 == 0 && side <= MAX_TILES);
+
+	// The prefix is generated by a run of its own, which also takes care of
+	// resuming, and then goes out through this one like any other points.
+	// In 64 bits, since with lots of tiles it's more than a uint32_t holds.
+	auto prefix_count = (uint32_t)std::min<uint64_t>(n, std::max<uint64_t>(
+		(uint64_t)TILED_PREFIX_PER_TILE * tile_count,
+		config.resume.size()));
+
+	ivs_config exact = config;
+	ivs_stats exact_stats;
+
+	exact.point_count  = prefix_count;
+	exact.engine       = ivs_engine::compact;
+	exact.final_name   = "";
+	exact.inter_format = "";
+	exact.async        = false;
+	exact.log_progress = false;
+	exact.stats        = stats ? &exact_stats : nullptr;
+	exact.emit_at.clear();
+	exact.snapshot     = nullptr;
+	exact.final_trig   = nullptr;
+
+	auto prefix = generate_ivs(exact);
+
+	if (stats) {
+		auto total = stats->total;
+		*stats = exact_stats;
+		stats->total = total;
+	}
+
+	for (uint32_t i = 0; i < prefix_count; i++) {
+		run.emit(i, prefix[i]);
+		run.progress.log(i, n);
+	}
+
+	{
+		phase_timer timer { phase(stats, &ivs_stats::bulk_fill) };
+
+		std::vector<PDT::Point> sites;
+		sites.reserve(prefix.size());
+
+		for (auto p : prefix) {
+			sites.emplace_back(p.x, p.y);
+		}
+
+		trig.insert(sites.begin(), sites.end(), true);
+	}
+
+	if (prefix_count == n) {
+		return n;
+	}
+
+	// The largest circle after the prefix, which is as big as circles get
+	// from here on
+	double r2 = 0;
+
+	{
+		auto &faces = run.buffers->faces;
+		auto &circles = run.buffers->circles;
+
+		faces.clear();
+
+		for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+			faces.push_back(it);
+		}
+
+		compute_circles(trig, faces, circles);
+
+		for (size_t k = 0; k < faces.size(); k++) {
+			r2 = std::max(r2, circles.r2(k));
+		}
+	}
+
+	auto radius = std::sqrt(r2);
+
+	if (!is_one_sheet(trig) || radius >= 0.25 / side) {
+		if (config.log_progress) {
+			std::cerr << std::endl << "Too many tiles for the prefix, generating the rest exactly" << std::endl;
+		}
+
+		return prefix_count;
+	}
+
+	worker_pool pool { config.threads };
+	std::vector<std::unique_ptr<tile_refiner>> tiles;
+
+	{
+		phase_timer timer { phase(stats, &ivs_stats::bulk_fill) };
+
+		std::vector<tiled_point> exact_points;
+		exact_points.reserve(prefix.size());
+
+		for (auto p : prefix) {
+			exact_points.push_back(tiled_point { p, std::numeric_limits<double>::infinity() });
+		}
+
+		for (uint32_t t = 0; t < tile_count; t++) {
+			tiles.push_back(std::make_unique<tile_refiner>(t % side, t / side, side, 2 * radius));
+		}
+
+		pool.parallel_for(tile_count, [&](size_t t) {
+			tiles[t]->assign(exact_points);
+		});
+	}
+
+	// Which of the four colors a tile is, and the tiles around it (fewer than
+	// eight if there's only two on a side, then the left and right neighbors
+	// are the same tile)
+	auto color_of = [&](size_t t) {
+		return (uint32_t)((t % side) % 2 + 2 * ((t / side) % 2));
+	};
+
+	std::vector<std::vector<size_t>> neighbors(tile_count);
+
+	for (size_t t = 0; t < tile_count; t++) {
+		auto tx = t % side;
+		auto ty = t / side;
+
+		for (size_t dy = side - 1; dy <= side + 1; dy++) {
+			for (size_t dx = side - 1; dx <= side + 1; dx++) {
+				auto s = ((ty + dy) % side) * side + (tx + dx) % side;
+
+				if (s != t) neighbors[t].push_back(s);
+			}
 		}
 
-        // Draw intermediate images and record the points
-		draw_inter(trig, i);
-		log_progress(i, opts.point_count);
+		std::sort(neighbors[t].begin(), neighbors[t].end());
+		neighbors[t].erase(std::unique(neighbors[t].begin(), neighbors[t].end()), neighbors[t].end());
 	}
 
-    // Log that we've finished
-	log_progress(opts.point_count, opts.point_count, true);
-	std::cerr << std::endl;
+	std::vector<std::vector<tiled_point>> fresh(tile_count);
+	std::vector<tiled_point> round;
+
+	// The points after the prefix, if there's a final image to draw
+	std::vector<PDT::Point> generated;
+
+	uint32_t i = prefix_count;
+	double threshold2 = r2;
+
+	while (i < n) {
+		// The squared radius goes roughly as one over the number of points,
+		// so that's about where the point count is reached. The last round
+		// aims a bit lower, so that it gets there in one go.
+		threshold2 = std::max(
+			threshold2 * TILED_ROUND_SHRINK * TILED_ROUND_SHRINK,
+			0.98 * threshold2 * i / n);
+
+		if (stats) stats->tiled_rounds++;
+
+		round.clear();
+
+		for (uint32_t color = 0; color < 4; color++) {
+			{
+				phase_timer timer { phase(stats, &ivs_stats::tiled_refine) };
+
+				pool.parallel_for(tile_count, [&](size_t t) {
+					if (color_of(t) != color) return;
+
+					fresh[t].clear();
+					tiles[t]->refine(threshold2, fresh[t]);
+				});
+			}
+
+			{
+				phase_timer timer { phase(stats, &ivs_stats::tiled_exchange) };
+
+				pool.parallel_for(tile_count, [&](size_t t) {
+					if (color_of(t) == color) return;
+
+					for (auto s : neighbors[t]) {
+						if (color_of(s) == color) {
+							tiles[t]->insert_halo(fresh[s]);
+						}
+					}
+				});
+			}
+
+			for (size_t t = 0; t < tile_count; t++) {
+				if (color_of(t) == color) {
+					round.insert(round.end(), fresh[t].begin(), fresh[t].end());
+				}
+			}
+		}
+
+		{
+			phase_timer timer { phase(stats, &ivs_stats::output) };
+
+			std::sort(round.begin(), round.end(), [](const tiled_point &a, const tiled_point &b) {
+				return b < a;
+			});
+		}
+
+		auto take = std::min<size_t>(round.size(), n - i);
+
+		if (stats) stats->tiled_overshoot += round.size() - take;
+
+		for (size_t k = 0; k < take; k++, i++) {
+			run.emit(i, round[k].point);
+			run.progress.log(i, n);
+
+			if (wants_final_trig(config)) {
+				generated.emplace_back(round[k].point.x, round[k].point.y);
+			}
+		}
+	}
+
+	if (stats) {
+		stats->queued_points += n - prefix_count;
+
+		for (const auto &tile : tiles) {
+			stats->pops             += tile->pops;
+			stats->removed_faces    += tile->removed_faces;
+			stats->created_faces    += tile->created_faces;
+			stats->order_inversions += tile->inversions;
+		}
+	}
+
+	if (wants_final_trig(config)) {
+		phase_timer timer { phase(stats, &ivs_stats::insert) };
+		trig.insert(generated.begin(), generated.end(), true);
+	}
+
+	return i;
+}
+
+set_quality measure_quality(const std::vector<vec2> &points, size_t count, size_t seed_count)
+{
+	count = std::min(count, points.size());
+	seed_count = std::min(seed_count, count);
+
+	PDT trig { PDT::Iso_rectangle { 0, 0, 1, 1 } };
+	std::vector<PDT::Point> sites;
+
+	sites.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		sites.emplace_back(points[i].x, points[i].y);
+	}
+
+	trig.insert(sites.begin(), sites.end(), true);
+
+	auto is_seed = [&](PDT::Vertex_handle v) {
+		auto p = v->point();
+
+		for (size_t i = 0; i < seed_count; i++) {
+			if (points[i].x == p.x() && points[i].y == p.y()) return true;
+		}
+
+		return false;
+	};
+
+	std::vector<PDT::Face_handle> faces;
+	circle_batch circles;
+
+	for (auto it = trig.faces_begin(); it != trig.faces_end(); it++) {
+		faces.push_back(it);
+	}
+
+	compute_circles(trig, faces, circles);
+
+	set_quality quality { std::numeric_limits<double>::infinity(), 0 };
+
+	for (size_t k = 0; k < faces.size(); k++) {
+		quality.covering_radius = std::max(quality.covering_radius, std::sqrt(circles.r2(k)));
+
+		// Every edge is in two faces, which doesn't matter for the smallest
+		vec2 p[3];
+		corners(trig, faces[k], p[0], p[1], p[2]);
+
+		for (int e = 0; e < 3; e++) {
+			int f = (e + 1) % 3;
+
+			if (is_seed(faces[k]->vertex(e)) && is_seed(faces[k]->vertex(f))) continue;
+
+			quality.min_distance = std::min(quality.min_distance, glm::distance(p[e], p[f]));
+		}
+	}
+
+	return quality;
+}
+
+/**
+ * Main procedure for the algorithm.
+ */
+void generate_ivs(const ivs_config &config, const point_callback &callback)
+{
+	const auto &seeds = config.seeds;
+	auto stats = stats_of(config);
+
+	if (config.point_count > MAX_POINT_COUNT) {
+		throw std::invalid_argument("Too many points, see MAX_POINT_COUNT");
+	}
+
+	phase_timer total_timer { phase(stats, &ivs_stats::total) };
+
+	PDT trig { PDT::Iso_rectangle { 0, 0, 1, 1 } };
+	ivs_run run { config, callback };
+
+	uint32_t i = 0;
+
+	if (config.engine == ivs_engine::tiled) {
+		i = run_tiled(run, trig);
+	} else if (config.resume.empty()) {
+		// Add the seeds
+		for (; i < seeds.size(); i++) {
+			add_point(run, trig, i, seeds[i]);
+		}
+	} else {
+		i = resume(run, trig);
+	}
+
+	// Start out in nine-sheet mode, and switch over to the priority queue once
+	// CGAL has switched to one-sheet mode. Loops in case it ever switches back.
+	while (i < config.point_count) {
+		if (!is_one_sheet(trig)) {
+			i = run_nine_sheet(run, trig, i);
+		}
+
+		if (i < config.point_count) {
+			auto &b = *run.buffers;
+			bool buckets = config.queue == ivs_queue::bucket;
+
+			// The tiled engine only gets here if it gave up on tiles, and
+			// then it's as good as the compact one
+			if (config.engine != ivs_engine::cgal) {
+				i = buckets
+					? run_compact(run, trig, b.compact_bucket_pq, i)
+					: run_compact(run, trig, b.compact_pq, i);
+			} else {
+				i = buckets
+					? run_cgal(run, trig, b.cgal_bucket_pq, i)
+					: run_cgal(run, trig, b.cgal_pq, i);
+			}
+		}
+	}
+
+	// Wait for the output and the frames to catch up
+	if (run.pipeline) {
+		if (config.log_progress && config.inter_format != "") {
+			std::cerr << std::endl << "Waiting for the intermediate frames";
+		}
+
+		phase_timer timer { phase(stats, &ivs_stats::output) };
+		run.pipeline->finish();
+	}
+
+	// Log that we've finished
+	if (config.log_progress) {
+		run.progress.log(config.point_count, config.point_count, true);
+		std::cerr << std::endl;
+	}
+
+	if (config.final_name != "") {
+		if (config.log_progress) {
+			std::cerr << "Drawing final result to " << config.final_name << std::endl;
+		}
+		draw_trig(config.final_name.c_str(), trig, config.draw);
+	}
+
+	if (config.final_trig) {
+		config.final_trig(trig);
+	}
 
-    if (opts.final_name != "") {
-        std::cerr << "Drawing final result to " << opts.final_name << std::endl;
-        draw_trig(opts.final_name.c_str(), trig);
-    }
+	if (stats) stats->peak_rss = peak_rss();
 }
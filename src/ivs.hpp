@@ -0,0 +1,682 @@
+/**
+
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ * 
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Main header file for the IVS library (libivs). Everything that has to do with
+ * actually generating and drawing the sets lives behind this header, the
+ * command line tool is just a thin layer on top of it (see main.hpp).
+ *
+ * I chucked in as many includes as I could here, because CGAL is header-only
+ * and *massive*, so compiling any file with it included took like 400 years (i
+ * mean, not really, but enough time that rapid recompile became super
+ * annoying). Therefore I chucked CGAL and as many other header-only libraries
+ * (glm, and <chrono> and <random> are the other big ones I guess) as I could in
+ * this file and told CMake to make it a precompiled header. That actually more
+ * or less works with clang, compile times where much reduced. Fun times!
+ *
+ * It's maybe weird that I use glm here, but I'm so used to using that for
+ * vectors in C++ (and in GLSL obviously), so I tend just to default for that
+ * for my vector structs. I suppose I could have used something from CGAL, but
+ * I'd like to avoid CGAL for as much as humanly possible. 
+ *
+ * There are no globals in the library, everything it needs is passed in through
+ * ivs_config, so it's fine to run several generators at the same time.
+ */
+
+#pragma once
+
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Periodic_2_Delaunay_triangulation_2.h>
+#include <CGAL/Periodic_2_Delaunay_triangulation_traits_2.h>
+#include <CGAL/Periodic_2_triangulation_face_base_2.h>
+#include <CGAL/Periodic_2_triangulation_vertex_base_2.h>
+#include <CGAL/Triangulation_data_structure_2.h>
+#include <CGAL/Triangulation_face_base_with_info_2.h>
+#include <fstream>
+#include <cassert>
+#include <list>
+#include <vector>
+#include <random>
+#include <glm/glm.hpp>
+#include <cmath>
+#include <sstream>
+#include <queue>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <limits>
+
+#define TAU (2*M_PI)
+
+/**
+ * Extra stuff we keep in every face of the triangulation: where in the priority
+ * queue the face is, and the stamp of the queue entry that put it there (see
+ * face_queue.hpp). A stamp of 0 means the face has never been in the queue.
+ */
+struct face_info {
+	uint32_t slot;
+	uint32_t stamp;
+
+	face_info()
+		: slot  { std::numeric_limits<uint32_t>::max() }
+		, stamp { 0 }
+	{
+	}
+};
+
+typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+typedef CGAL::Periodic_2_Delaunay_triangulation_traits_2<K> GT;
+
+typedef CGAL::Periodic_2_triangulation_vertex_base_2<GT>             Vb;
+typedef CGAL::Periodic_2_triangulation_face_base_2<GT>               Fb_base;
+typedef CGAL::Triangulation_face_base_with_info_2<face_info, GT, Fb_base> Fb;
+typedef CGAL::Triangulation_data_structure_2<Vb, Fb>                 Tds;
+
+typedef CGAL::Periodic_2_Delaunay_triangulation_2<GT, Tds>  PDT;
+
+using vec2 = glm::dvec2;
+using vec3 = glm::dvec3;
+using vec4 = glm::dvec4;
+
+/**
+ * Formats for the output point file. See pointfile.cpp for the details.
+ */
+enum class point_format {
+	text,
+	binary,
+	binary32,
+};
+
+/**
+ * Size and version of the header at the start of binary point files.
+ */
+constexpr uint32_t POINT_FILE_HEADER_SIZE = 24;
+constexpr uint32_t POINT_FILE_VERSION = 1;
+
+/**
+ * The stuff that goes into the header of a binary point file. 
+ */
+struct point_file_header {
+	uint32_t point_count;
+	uint32_t rng_seed;
+	uint32_t seed_count;
+};
+
+/**
+ * Buffered writer for the generated points. Subclasses encode the points in
+ * the different formats, this base class just deals with the buffering so that
+ * we don't hit the stream for every single point.
+ */
+class point_writer
+{
+public:
+	virtual ~point_writer();
+
+	/**
+	 * Write a single point.
+	 */
+	virtual void write(vec2 point) = 0;
+
+	/**
+	 * Write out everything that's buffered and flush the underlying stream.
+	 */
+	void flush();
+
+protected:
+	point_writer(std::ostream &out);
+
+	/**
+	 * Make sure there's at least size bytes free in the buffer, and return a
+	 * pointer to where to write them. Call commit with the end of what you
+	 * actually wrote when you're done.
+	 */
+	char *reserve(size_t size);
+	void commit(char *end);
+
+private:
+	std::ostream &out;
+	std::vector<char> buffer;
+	size_t used;
+};
+
+/**
+ * Create a point writer writing the given format to out. The header is only
+ * used by the binary formats.
+ */
+std::unique_ptr<point_writer> make_point_writer(
+	point_format format,
+	std::ostream &out,
+	const point_file_header &header);
+
+/**
+ * Parse the name of a point format ("text", "binary" or "binary32"). Returns
+ * false if it's not a name we know.
+ */
+bool parse_point_format(const std::string &name, point_format &format);
+
+/**
+ * Read a point file written by one of the point writers. Which format it is
+ * gets figured out from the contents, and "-" reads from stdin. If header isn't
+ * null, it gets the header of a binary file (text files don't have one, so all
+ * you get is the point count). Returns false, and complains on stderr, if the
+ * file couldn't be read.
+ */
+bool read_points(
+	const std::string &file,
+	std::vector<vec2> &points,
+	point_file_header *header = nullptr);
+
+/**
+ * Options for drawing the triangulations. 
+ */
+struct draw_options {
+	// ints instead of bools to integrate nicer with getopt
+	int draw_voronoi;
+	int draw_triangulation;
+	int draw_circumcircles;
+
+	float point_size;
+	float line_width;
+	uint32_t img_size;
+
+	// Threads to draw the dots with, 0 means one per hardware thread (see
+	// site_raster.cpp)
+	uint32_t threads;
+
+	draw_options()
+		: draw_voronoi       { false }
+		, draw_triangulation { false }
+		, draw_circumcircles { false }
+		, point_size { 3.0f }
+		, line_width { 1.0f }
+		, img_size   { 1024 }
+		, threads    { 0 }
+	{
+	}
+};
+
+/**
+ * The counters and timers below can be compiled out entirely, by building with
+ * IVS_STATS=0 (the IVS_STATS option in CMake). Then the generator never
+ * touches an ivs_stats, even if you give it one.
+ */
+#ifndef IVS_STATS
+#define IVS_STATS 1
+#endif
+
+/**
+ * Timings and counters for the different phases of the generator, mostly
+ * useful for benchmarking. Times are in seconds. 
+ */
+struct ivs_stats {
+	// Time spent looping over all faces looking for the largest circumcircle
+	// while in nine-sheet mode
+	double nine_sheet_scan;
+
+	// Time spent filling the priority queue with every face when switching to
+	// one-sheet mode
+	double bulk_fill;
+
+	// Time spent inserting points into the triangulation
+	double insert;
+
+	// Time spent adding the newly created faces to the priority queue
+	double enqueue;
+
+	// Time spent popping the priority queue
+	double pop;
+
+	// Time spent finding the faces a new point will destroy and removing
+	// them from the priority queue
+	double remove;
+
+	// Time spent in the point callback
+	double output;
+
+	// Time the tiled engine spent refining tiles, and exchanging the new
+	// points with the neighboring tiles
+	double tiled_refine;
+	double tiled_exchange;
+
+	// Total time for the whole thing
+	double total;
+
+	// Number of points inserted from the priority queue (i.e. everything
+	// after the switch to one-sheet mode)
+	uint64_t queued_points;
+
+	// Number of entries popped from the priority queue, and how many of those
+	// were for faces that had already been destroyed. The queue never holds
+	// destroyed faces, so the only stale pops are the ones the speculative
+	// loop pops ahead of time.
+	uint64_t pops;
+	uint64_t stale_pops;
+
+	// Number of faces removed from the priority queue because they were
+	// destroyed by an insertion
+	uint64_t removed_faces;
+
+	// Number of faces created by insertions
+	uint64_t created_faces;
+
+	// Largest size the priority queue ever reached, and the sum of its size
+	// after every queued point (for the average)
+	uint64_t queue_high_water;
+	uint64_t queue_size_sum;
+
+	// Index of the point that triggered the switch to one-sheet mode
+	uint32_t one_sheet_switch;
+
+	// Number of conflict zones that were computed in parallel but had to be
+	// computed again because an earlier point got in the way
+	uint64_t speculation_misses;
+
+	// Rounds the tiled engine took, and how many points it generated in the
+	// last one that didn't fit in the point count
+	uint64_t tiled_rounds;
+	uint64_t tiled_overshoot;
+
+	// Points from the tiled engine where one of the corners of their circle
+	// comes after them in the output. In the exact engines the corners are
+	// always earlier points, so this is how far the order is from exact.
+	uint64_t order_inversions;
+
+	// Peak resident set size of the process in bytes, when the generator
+	// finished (see peak_rss)
+	uint64_t peak_rss;
+
+	ivs_stats()
+		: nine_sheet_scan { 0 }
+		, bulk_fill { 0 }
+		, insert    { 0 }
+		, enqueue   { 0 }
+		, pop       { 0 }
+		, remove    { 0 }
+		, output    { 0 }
+		, tiled_refine   { 0 }
+		, tiled_exchange { 0 }
+		, total     { 0 }
+		, queued_points    { 0 }
+		, pops             { 0 }
+		, stale_pops       { 0 }
+		, removed_faces    { 0 }
+		, created_faces    { 0 }
+		, queue_high_water { 0 }
+		, queue_size_sum   { 0 }
+		, one_sheet_switch { 0 }
+		, speculation_misses { 0 }
+		, tiled_rounds     { 0 }
+		, tiled_overshoot  { 0 }
+		, order_inversions { 0 }
+		, peak_rss         { 0 }
+	{
+	}
+};
+
+/**
+ * Write the stats as the members of a JSON object (no braces, so you can put
+ * your own stuff next to them), one per line, each line starting with indent.
+ */
+void write_stats_json(std::ostream &out, const ivs_stats &stats, const std::string &indent);
+
+/**
+ * Peak resident set size of the process in bytes. 
+ */
+uint64_t peak_rss();
+
+/**
+ * Reset the peak resident set size, so that peak_rss measures from here. Only
+ * works on Linux, everywhere else the peak is just the peak of the whole
+ * process so far.
+ */
+void reset_peak_rss();
+
+/**
+ * Which triangulation to use once the generator has switched to one-sheet mode
+ * (the nine-sheet part always uses CGAL). Both produce exactly the same points,
+ * the compact one is just faster and uses less memory. See compact_trig.cpp.
+ *
+ * The tiled one is different: it's not exact. It generates a prefix of the set
+ * with the compact engine, then splits the torus into tiles and fills them in
+ * on several threads at once, with the order of the points only roughly the
+ * exact one. See run_tiled in ivs.cpp.
+ */
+enum class ivs_engine {
+	cgal,
+	compact,
+	tiled,
+};
+
+/**
+ * Parse an engine name ("cgal", "compact" or "tiled") into engine. Returns
+ * false if it's not a name we know.
+ */
+bool parse_engine(const std::string &name, ivs_engine &engine);
+
+/**
+ * The name of an engine, the other way around from parse_engine.
+ */
+const char *engine_name(ivs_engine engine);
+
+/**
+ * Most points generate_ivs makes in one set. The faces in the queue are told
+ * apart by 32-bit stamps, and every point uses up about 6 of them, so this
+ * leaves plenty of room. Bigger sets would need bigger stamps (and queue
+ * entries).
+ */
+constexpr uint32_t MAX_POINT_COUNT = 500000000;
+
+/**
+ * Most tiles on each side the tiled engine takes (see ivs_config::tiles). The
+ * exact prefix is 1024 points per tile, and with more tiles than this that's
+ * over 2^31 points.
+ */
+constexpr uint32_t MAX_TILES = 1448;
+
+/**
+ * Which priority queue to keep the faces in. The heap is a 4-ary addressable
+ * heap, where every face knows its slot so it can be removed
+ * (face_queue.hpp). The bucket one only sorts the largest circles and parks
+ * the rest in buckets (bucket_queue.hpp), which is faster for big sets. Both
+ * produce exactly the same points.
+ */
+enum class ivs_queue {
+	heap,
+	bucket,
+};
+
+/**
+ * Parse a queue name ("heap" or "bucket") into queue. Returns false if it's
+ * not a name we know.
+ */
+bool parse_queue(const std::string &name, ivs_queue &queue);
+
+/**
+ * Memory the generator can hang on to between runs: the priority queue, the
+ * compact triangulation and a bunch of scratch buffers. If you generate a lot
+ * of sets one after the other (like ivs batch does), giving them all the same
+ * workspace means that memory only gets allocated once, instead of being built
+ * up and torn down for every set. A workspace can only be used by one run at a
+ * time, so use one per thread.
+ */
+class ivs_workspace
+{
+public:
+	ivs_workspace();
+	~ivs_workspace();
+
+	ivs_workspace(const ivs_workspace&) = delete;
+	ivs_workspace &operator=(const ivs_workspace&) = delete;
+
+private:
+	friend struct ivs_run;
+
+	// See ivs.cpp
+	struct buffers;
+	std::unique_ptr<buffers> b;
+};
+
+/**
+ * Callback for the snapshots (see ivs_config::emit_at). Gets the number of
+ * points in the snapshot, and the stats as they were when the last of them was
+ * generated (null if stats aren't being recorded).
+ */
+using snapshot_callback = std::function<void(uint32_t count, const ivs_stats *stats)>;
+
+/**
+ * Callback for the final triangulation (see ivs_config::final_trig).
+ */
+using trig_callback = std::function<void(const PDT &trig)>;
+
+/**
+ * Everything the generator needs to know to generate a set. 
+ */
+struct ivs_config {
+	// Total number of points to generate (including the seeds), at most
+	// MAX_POINT_COUNT
+	uint32_t point_count;
+
+	// The initial points, see make_seeds
+	std::vector<vec2> seeds;
+
+	// Points of an earlier run to continue from (see read_points). If this
+	// isn't empty, the seeds are ignored: these become the first points of
+	// the set, and generation continues exactly where that run stopped. They
+	// go through the callback like the rest, so you get the whole set.
+	std::vector<vec2> resume;
+
+	// If not empty, the final triangulation is drawn to this file
+	std::string final_name;
+
+	// If not empty, a printf-style format (taking the point index) for
+	// drawing every intermediate triangulation
+	std::string inter_format;
+
+	// Only write every inter_stride:th intermediate frame (and the last one)
+	uint32_t inter_stride;
+
+	draw_options draw;
+
+	// Triangulation used for the one-sheet part
+	ivs_engine engine;
+
+	// Priority queue used for the one-sheet part
+	ivs_queue queue;
+
+	// Number of threads to use, 0 means one per hardware thread. Only the
+	// compact and tiled engines use more than one. The output is the same
+	// regardless.
+	uint32_t threads;
+
+	// Number of tiles on each side of the torus for the tiled engine. Has to
+	// be even, and at most MAX_TILES. The points depend on this (but not on
+	// the thread count), and you want at least a couple of tiles per thread.
+	uint32_t tiles;
+
+	// Call the callback and draw the intermediate frames on separate threads,
+	// so the generator never waits for them (see pipeline.cpp). The callback
+	// is still called in order, one point at a time, just not on the thread
+	// that called generate_ivs. Everything is done by the time generate_ivs
+	// returns.
+	bool async;
+
+	// Log progress to stderr while generating
+	bool log_progress;
+
+	// If not null, timings and counters are recorded here. If it is null, the
+	// generator doesn't even look at the clock.
+	ivs_stats *stats;
+
+	// If not null, the generator's big buffers come from here, and stay there
+	// for the next run to reuse. If it is null, they're allocated for this
+	// run and freed afterwards.
+	ivs_workspace *workspace;
+
+	// Point counts (in increasing order) to take snapshots at. When the first
+	// count points have all been through the callback, snapshot is called
+	// with count, on the same thread as the callback. Since every prefix of
+	// an IVS is an IVS, that's a whole smaller set, without generating it
+	// again. Whatever the snapshot does takes time away from the callback, so
+	// anything slow should be handed off to another thread.
+	std::vector<uint32_t> emit_at;
+	snapshot_callback snapshot;
+
+	// If set, called with the final triangulation of all the points before
+	// generate_ivs returns, after the last point has been through the
+	// callback. For anything that needs the whole triangulation, like the
+	// Voronoi cells (see voronoi_cells.hpp). The compact and tiled engines
+	// only build a CGAL triangulation at the end if this (or final_name) is
+	// set.
+	trig_callback final_trig;
+
+	ivs_config()
+		: point_count  { 4096 }
+		, seeds        { }
+		, resume       { }
+		, final_name   { "" }
+		, inter_format { "" }
+		, inter_stride { 1 }
+		, draw         { }
+		, engine       { ivs_engine::cgal }
+		, queue        { ivs_queue::heap }
+		, threads      { 1 }
+		, tiles        { 8 }
+		, async        { false }
+		, log_progress { false }
+		, stats        { nullptr }
+		, workspace    { nullptr }
+		, emit_at      { }
+		, snapshot     { }
+		, final_trig   { }
+	{
+	}
+};
+
+/**
+ * Callback receiving the points as they're generated, in order. The index is
+ * the rank of the point in the set (the seeds come first).
+ */
+using point_callback = std::function<void(uint32_t index, vec2 point)>;
+
+/**
+ * The main IVS algorithm. Calls callback with every point as soon as it's been
+ * generated, so you can stream them wherever you like. 
+ */
+void generate_ivs(const ivs_config &config, const point_callback &callback);
+
+/**
+ * Same as above, but just collects all the points and returns them. 
+ */
+std::vector<vec2> generate_ivs(const ivs_config &config);
+
+/**
+ * Generate seed_count random seed points in [0,1)x[0,1) from the given RNG
+ * seed. This is what the command line tool uses for its seeds.
+ */
+std::vector<vec2> make_seeds(uint32_t rng_seed, uint32_t seed_count);
+
+/**
+ * How evenly spread out a set is: the smallest distance between two points,
+ * and the radius of the largest empty circle. For an exact IVS, every prefix
+ * has the two about equal (each point went in at the center of the largest
+ * circle, so it's exactly that far from its closest neighbors).
+ */
+struct set_quality {
+	double min_distance;
+	double covering_radius;
+};
+
+/**
+ * Measure the quality of the first count points of a set (which has to have
+ * enough points for a one-sheet triangulation, a few dozen does it). The seeds
+ * are random, so they can be as close to each other as they like: distances
+ * between two of the first seed_count points don't count.
+ */
+set_quality measure_quality(const std::vector<vec2> &points, size_t count, size_t seed_count);
+
+/**
+ * Return the signed area of a triangle with points a, b, c
+ */
+double signed_area(vec2 a, vec2 b, vec2 c);
+
+/**
+ * Find the intersection of two lines defined by a position and direction
+ * vector, returning the required coefficiant of the direction vectors. That is,
+ * if the two lines are defined as:
+ *
+ *   l0(t) = p0 + t * v0
+ *   l1(t) = p1 + t * v1
+ *
+ * Then the intersection is at l0(m0) and l1(m1).
+ *
+ * Returns false if there is no intersection (and m0 and m1 are NaN).
+ */
+bool line_line_intersection(vec2 p0, vec2 v0, vec2 p1, vec2 v1, double &m0, double &m1);
+
+/**
+ * Rotate a vector v CCW 90 degrees (i.e. if v was a complex number, the
+ * equivalent of multiplying with i).
+ */
+vec2 rotate(vec2 v);
+
+/**
+ * Returns the center of the circumcircle of three given points. Will return
+ * NaN's if there isn't any.
+ *
+ * TODO: error-checking by returning NaN's is dumb, this should return a bool
+ * and have the result in an argument passed by ref. Or, if you wanna look cool
+ * at all the C++ parties, return a std::optional. 
+ */
+vec2 circumcircle_center(vec2 c0, vec2 c1, vec2 c2);
+
+/**
+ * Center and squared radius of the circumcircle of a triangle. Unlike
+ * circumcircle_center, the result doesn't depend on which order the corners
+ * are given in (down to the last bit), which matters because the two
+ * triangulation engines don't agree on which corner of a face comes first.
+ * Gives exactly the same result as circle_batch (see circumcircle.hpp), which
+ * is what you want if you have more than one.
+ */
+void circumcircle(vec2 p0, vec2 p1, vec2 p2, vec2 &center, double &r2);
+
+/**
+ * Utility functions to turn points from the internal Delaunay triangulation
+ * structure into regular vec2's.
+ */
+vec2 point(const PDT &trig, const PDT::Periodic_point pnt);
+vec2 point(const PDT &trig, const PDT::Vertex_handle pnt);
+
+/**
+ * Draw a triangulation using the given options and save the drawing to a file.
+ * Mostly used for debugging and fancy GitHub gifs. 
+ */
+void draw_trig(const char *file, const PDT &trig, const draw_options &draw);
+
+/**
+ * Draws the intermediate frames of a run. Instead of drawing every frame from
+ * scratch, it keeps one image around and only draws what changed: just the new
+ * dot if there's nothing but dots, otherwise the region around the new point,
+ * from its own copy of the triangulation (see drawer.cpp). Frames are
+ * written according to config.inter_format and config.inter_stride.
+ */
+class frame_renderer
+{
+public:
+	explicit frame_renderer(const ivs_config &config);
+	~frame_renderer();
+
+	/**
+	 * Add point number index, and write a frame for it if draw is set (and
+	 * it's on the stride).
+	 */
+	void add_point(uint32_t index, vec2 point, bool draw = true);
+
+private:
+	struct state;
+
+	const ivs_config &config;
+
+	// Any of the lines or circles turned on, otherwise it's just dots
+	bool decorated;
+
+	std::unique_ptr<state> s;
+
+	void update_region(vec2 point);
+};
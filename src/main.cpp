@@ -19,12 +19,146 @@
 
 #include "main.hpp"
 
+#include <thread>
+
+/**
+ * Write the --stats report for a set of point_count points to file. cache is
+ * what the cache did ("hit", "resume" or "miss"), or null if there isn't one.
+ */
+static void write_stats(
+	const std::string &name,
+	uint32_t point_count,
+	const ivs_config &config,
+	const ivs_stats &stats,
+	const char *cache = nullptr)
+{
+	std::ofstream file;
+
+	if (name != "-") {
+		file.open(name);
+
+		if (!file) {
+			std::cerr << "Failed to open " << name << std::endl;
+			return;
+		}
+	}
+
+	std::ostream &out = file.is_open() ? file : std::cerr;
+
+	out << "{\n"
+		<< "  \"point_count\": " << point_count << ",\n"
+		<< "  \"engine\": \"" << engine_name(config.engine) << "\",\n"
+		<< "  \"queue\": \"" << (config.queue == ivs_queue::bucket ? "bucket" : "heap") << "\",\n"
+		<< "  \"threads\": " << config.threads << ",\n";
+
+	if (config.engine == ivs_engine::tiled) {
+		out << "  \"tiles\": " << config.tiles << ",\n";
+	}
+
+	if (cache) {
+		out << "  \"cache\": \"" << cache << "\",\n";
+	}
+
+	write_stats_json(out, stats, "  ");
+
+	out << "}\n";
+}
+
+/**
+ * The name of a snapshot's copy of a file: the count goes in before the
+ * extension, so points.txt becomes points-1024.txt.
+ */
+static std::string snapshot_name(const std::string &file, uint32_t count)
+{
+	auto slash = file.find_last_of("/\\");
+	auto dot = file.find_last_of('.');
+
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || dot == slash + 1) {
+		dot = file.size();
+	}
+
+	return file.substr(0, dot) + "-" + std::to_string(count) + file.substr(dot);
+}
+
+/**
+ * Draw the triangulation of count points to file name.
+ */
+static void draw_points(const std::string &name, const vec2 *points, size_t count, const draw_options &draw)
+{
+	// Same points, same triangulation, no matter what order they go in
+	PDT trig { PDT::Iso_rectangle { 0, 0, 1, 1 } };
+	std::vector<PDT::Point> sites;
+
+	sites.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		sites.emplace_back(points[i].x, points[i].y);
+	}
+
+	trig.insert(sites.begin(), sites.end(), true);
+	draw_trig(name.c_str(), trig, draw);
+}
+
+/**
+ * Save the snapshot of the first points.size() points (see --emit-at): a copy
+ * of every file that's being saved for the whole set. Runs on a thread of its
+ * own, so it can take its time.
+ */
+static void save_snapshot(const ivs_config &config, const std::vector<vec2> &points, const ivs_stats *stats)
+{
+	auto count = (uint32_t)points.size();
+
+	if (opts.output_file != "" && opts.output_file != "-") {
+		auto name = snapshot_name(opts.output_file, count);
+		std::ofstream out { name, std::ios::out | std::ios::binary };
+
+		if (!out) {
+			std::cerr << "Failed to open " << name << std::endl;
+		} else {
+			point_file_header header { count, opts.rng_seed, opts.seed_count };
+			auto writer = make_point_writer(opts.output_format, out, header);
+
+			for (auto point : points) {
+				writer->write(point);
+			}
+
+			writer->flush();
+		}
+	}
+
+	if (config.final_name != "") {
+		draw_points(snapshot_name(config.final_name, count), points.data(), points.size(), config.draw);
+	}
+
+	// Several JSON objects on stderr wouldn't be much use, so only for files
+	if (stats && opts.stats_file != "-") {
+		write_stats(snapshot_name(opts.stats_file, count), count, config, *stats);
+	}
+}
+
 /**
  * Main function. Parses command line arguments, generates the seed points, runs
- * the algoritm.
+ * the algoritm. Or hands off to one of the subcommands.
  */
 int main(int argc, char **argv)
 {
+	// Subcommands
+	if (argc > 1 && strcmp(argv[1], "stipple") == 0) {
+		return stipple_main(argc - 1, argv + 1);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "rankmap") == 0) {
+		return rank_map_main(argc - 1, argv + 1);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "batch") == 0) {
+		return batch_main(argc - 1, argv + 1);
+	}
+
+	if (argc > 1 && strcmp(argv[1], "analyze") == 0) {
+		return analyze_main(argc - 1, argv + 1);
+	}
+
 	if (!parse_options(argc, argv)) {
 		return 1;
 	}
@@ -34,22 +168,183 @@ int main(int argc, char **argv)
 		return 0;
 	}
 
-	std::mt19937 engine { opts.rng_seed } ;
-	std::uniform_real_distribution dist;
+	// A --resume set might have lost precision (binary32), so those stay out
+	// of the cache. So do tiled sets, which aren't prefixes of each other.
+	bool use_cache = opts.cache_dir != ""
+		&& opts.resume_points.empty()
+		&& opts.engine != ivs_engine::tiled;
+
+	ivs_config config;
+
+	config.point_count  = opts.point_count;
+	config.seeds        = make_seeds(opts.rng_seed, opts.seed_count);
+	config.resume       = std::move(opts.resume_points);
+	config.final_name   = opts.final_name;
+	config.inter_format = opts.inter_format;
+	config.inter_stride = opts.inter_stride;
+	config.draw         = opts.draw;
+	config.engine       = opts.engine;
+	config.queue        = opts.queue;
+	config.threads      = opts.threads;
+	config.tiles        = opts.tiles;
+	config.async        = true;
+	config.log_progress = true;
+
+	ivs_stats stats;
+
+	if (opts.stats_file != "") {
+		config.stats = &stats;
+	}
+
+	// See --cache. If there's a cached set that's big enough, the generator
+	// doesn't run at all and the points come straight from the mapped file.
+	// If there's a smaller one, we continue from it. The intermediate frames
+	// need the generator to do all the work, so they don't get either.
+	std::unique_ptr<set_cache> cache;
+	cached_set cached;
+	const char *cache_result = nullptr;
+	bool served = false;
+
+	if (use_cache) {
+		cache = std::make_unique<set_cache>(opts.cache_dir, opts.cache_size);
+		cache_result = "miss";
+
+		if (config.inter_format == "" && cache->find(config.seeds, cached)) {
+			if (cached.size() >= config.point_count) {
+				served = true;
+				cache_result = "hit";
+			} else {
+				std::cerr << "Continuing from " << cached.size() << " cached points" << std::endl;
+
+				config.resume.assign(cached.begin(), cached.end());
+				cached.close();
+				cache_result = "resume";
+			}
+		}
+	}
+
+	point_callback callback;
+
+	// The index needs the whole set before it can be written, the snapshots
+	// need their part of it, the cache needs it to store it, and the cells
+	// need it to put the triangulation's vertices in rank order
+	std::vector<vec2> points;
+	bool keep_points = opts.index_file != "" || opts.cells_file != ""
+		|| !opts.emit_at.empty() || (cache && !served);
+
+	if (keep_points) {
+		points.reserve(config.point_count);
+	}
+
+	if (opts.writer || keep_points) {
+		callback = [&](uint32_t, vec2 point) {
+			if (opts.writer) opts.writer->write(point);
+			if (keep_points) points.push_back(point);
+		};
+	}
+
+	// The snapshots are saved on threads of their own, so that neither the
+	// output nor the generator has to wait for them. This runs on the output
+	// thread, which is the only one touching points while generating.
+	std::vector<std::thread> snapshots;
+
+	if (!opts.emit_at.empty()) {
+		config.emit_at = opts.emit_at;
+		config.snapshot = [&](uint32_t count, const ivs_stats *s) {
+			std::vector<vec2> prefix { points.begin(), points.begin() + count };
+			auto copy = s ? std::make_unique<ivs_stats>(*s) : nullptr;
+
+			snapshots.emplace_back([&config, prefix = std::move(prefix), copy = std::move(copy)] {
+				save_snapshot(config, prefix, copy.get());
+			});
+		};
+	}
+
+	// See --cells. The generator hands over the final triangulation after
+	// the last point has been through the callback, so points is complete.
+	bool cells_saved = true;
+
+	auto save_cells = [&](const PDT &trig) {
+		voronoi_cells cells;
+
+		cells_saved = compute_voronoi_cells(trig, points, opts.cell_neighbors, opts.threads, cells)
+			&& write_voronoi_cells(opts.cells_file, cells);
+	};
 
-	std::vector<vec2> seeds { opts.seed_count };
-	
-	for (int i = 0; i < opts.seed_count; i++)
-	{
-		seeds[i] = { dist(engine), dist(engine) };
+	if (opts.cells_file != "") {
+		config.final_trig = save_cells;
 	}
 
     try {
-        generate_ivs(seeds);
+        if (served) {
+            // Snapshots come after their last point, like in the generator
+            size_t next = 0;
+
+            for (uint32_t i = 0; i < config.point_count; i++) {
+                if (callback) callback(i, cached[i]);
+
+                if (next < config.emit_at.size() && config.emit_at[next] == i + 1) {
+                    config.snapshot(i + 1, nullptr);
+                    next++;
+                }
+            }
+
+            if (config.final_name != "") {
+                draw_points(config.final_name, cached.begin(), config.point_count, config.draw);
+            }
+
+            // No generator, so no triangulation either, but putting the
+            // points in one is a lot quicker than generating them
+            if (opts.cells_file != "") {
+                PDT trig { PDT::Iso_rectangle { 0, 0, 1, 1 } };
+                std::vector<PDT::Point> sites;
+
+                sites.reserve(points.size());
+
+                for (auto p : points) {
+                    sites.emplace_back(p.x, p.y);
+                }
+
+                trig.insert(sites.begin(), sites.end(), true);
+                save_cells(trig);
+            }
+        } else {
+            generate_ivs(config, callback);
+        }
+
+        if (opts.writer) {
+            opts.writer->flush();
+        }
     } catch (...) {
         std::cerr << "Failed to generate IVS" << std::endl;
+
+        for (auto &t : snapshots) t.join();
         return 1;
     }
 
+	for (auto &t : snapshots) {
+		t.join();
+	}
+
+	if (cache && !served) {
+		cache->store(config.seeds, opts.rng_seed, opts.seed_count, points);
+	}
+
+	if (opts.index_file != "") {
+		point_grid grid { points };
+
+		if (!write_point_index(opts.index_file, grid)) {
+			return 1;
+		}
+	}
+
+	if (!cells_saved) {
+		return 1;
+	}
+
+	if (opts.stats_file != "") {
+		write_stats(opts.stats_file, config.point_count, config, stats, cache_result);
+	}
+
 	return 0;
 }
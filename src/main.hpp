@@ -19,49 +19,17 @@
  */
 
 /**
- * Main and only header file for the project.
- *
- * I chucked in as many includes as I could here, because CGAL is header-only
- * and *massive*, so compiling any file with it included took like 400 years (i
- * mean, not really, but enough time that rapid recompile became super
- * annoying). Therefore I chucked CGAL and as many other header-only libraries
- * (glm, and <chrono> and <random> are the other big ones I guess) as I could in
- * this file and told CMake to make it a precompiled header. That actually more
- * or less works with clang, compile times where much reduced. Fun times!
- *
- * It's maybe weird that I use glm here, but I'm so used to using that for
- * vectors in C++ (and in GLSL obviously), so I tend just to default for that
- * for my vector structs. I suppose I could have used something from CGAL, but
- * I'd like to avoid CGAL for as much as humanly possible. 
- * 
+ * Header file for the command line tool. The actual algorithm lives in the
+ * library (see ivs.hpp), this is just the option parsing and such. 
  */
 
 #pragma once
 
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-#include <CGAL/Periodic_2_Delaunay_triangulation_2.h>
-#include <CGAL/Periodic_2_Delaunay_triangulation_traits_2.h>
-#include <fstream>
-#include <cassert>
-#include <list>
-#include <vector>
-#include <random>
-#include <glm/glm.hpp>
-#include <cmath>
-#include <sstream>
-#include <queue>
-#include <chrono>
-
-#define TAU (2*M_PI)
-
-typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
-typedef CGAL::Periodic_2_Delaunay_triangulation_traits_2<K> GT;
-typedef CGAL::Periodic_2_Delaunay_triangulation_2<GT>       PDT;
-
-using vec2 = glm::dvec2;
-using vec3 = glm::dvec3;
-using vec4 = glm::dvec4;
-	
+#include "ivs.hpp"
+#include "point_index.hpp"
+#include "set_cache.hpp"
+#include "voronoi_cells.hpp"
+
 /**
  * Struct to contain the various command line options. 
  */
@@ -71,37 +39,76 @@ struct options {
 
 	uint32_t point_count;
 
-	int draw_voronoi;
-	int draw_triangulation;
-	int draw_circumcircles;
+	draw_options draw;
 
 	std::string final_name;
 	std::string inter_format;
+	uint32_t inter_stride;
 	
 	uint32_t rng_seed;
 	uint32_t seed_count;
 
-	float point_size;
-	float line_width;
-	uint32_t img_size;
+	// Points to continue from, see --resume
+	std::vector<vec2> resume_points;
+
+	point_format output_format;
+
+	ivs_engine engine;
+	ivs_queue queue;
+	uint32_t threads;
+	uint32_t tiles;
+
+	// Where to write the stats, see --stats
+	std::string stats_file;
+
+	// Where to write the index, see --index
+	std::string index_file;
+
+	// Where to write the Voronoi cells, and whether to include the
+	// neighbors, see --cells
+	std::string cells_file;
+	int cell_neighbors;
+
+	// Counts to save snapshots at, see --emit-at
+	std::vector<uint32_t> emit_at;
+
+	// Name of the output file ("-" for stdout, empty for none)
+	std::string output_file;
+
+	// Directory of cached sets (empty for no cache) and how big it can get,
+	// see --cache
+	std::string cache_dir;
+	uint64_t cache_size;
 
     std::unique_ptr<std::ostream> output; 
+    std::unique_ptr<point_writer> writer;
 
 	options()
 		: print_help { false }
 		, point_count { 4096 }
-		, draw_voronoi       { false }
-		, draw_triangulation { false }
-		, draw_circumcircles { false }
+		, draw { }
 		, final_name   { "" }
 		, inter_format { "" }
+		, inter_stride { 1 }
 		, rng_seed   { 42 }
 		, seed_count { 3 }
-		, point_size { 3.0f }
-		, line_width { 1.0f }
-		, img_size   { 1024 }
+		, resume_points { }
+		, output_format { point_format::text }
+		, engine { ivs_engine::cgal }
+		, queue { ivs_queue::heap }
+		, threads { 1 }
+		, tiles { 8 }
+		, stats_file { "" }
+		, index_file { "" }
+		, cells_file { "" }
+		, cell_neighbors { false }
+		, emit_at { }
+		, output_file { "" }
+		, cache_dir { "" }
+		, cache_size { 1024ull << 20 }
 
         , output { nullptr }
+        , writer { nullptr }
 	{
 	}
 };
@@ -109,8 +116,8 @@ struct options {
 /**
  * The command line options. I guess it's better and more functional/modern to
  * pass this around as an argument, but you'd need to do that *everywhere*, and
- * this is such a small project. If i made this into a library, i definitely
- * would :) 
+ * this is such a small project. The library doesn't touch this, it gets
+ * everything it needs through ivs_config.
  */
 extern options opts;
 
@@ -125,57 +132,22 @@ void print_help();
 bool parse_options(int argc, char **argv);
 
 /**
- * The main IVS algorithm, with a vector of seeds. Prints out the results to
- * output file or stdout.
- *
- * TODO: this should probably return the list of points. 
+ * Entry point for `ivs stipple`. Gets the arguments after "stipple" (so
+ * argv[0] is "stipple"), returns the exit code.
  */
-void generate_ivs(const std::vector<vec2> &seeds);
+int stipple_main(int argc, char **argv);
 
 /**
- * Return the signed area of a triangle with points a, b, c
- */
-double signed_area(vec2 a, vec2 b, vec2 c);
-
-/**
- * Find the intersection of two lines defined by a position and direction
- * vector, returning the required coefficiant of the direction vectors. That is,
- * if the two lines are defined as:
- *
- *   l0(t) = p0 + t * v0
- *   l1(t) = p1 + t * v1
- *
- * Then the intersection is at l0(m0) and l1(m1).
- *
- * Returns false if there is no intersection (and m0 and m1 are NaN).
- */
-bool line_line_intersection(vec2 p0, vec2 v0, vec2 p1, vec2 v1, double &m0, double &m1);
-
-/**
- * Rotate a vector v CCW 90 degrees (i.e. if v was a complex number, the
- * equivalent of multiplying with i).
- */
-vec2 rotate(vec2 v);
-
-/**
- * Returns the center of the circumcircle of three given points. Will return
- * NaN's if there isn't any.
- *
- * TODO: error-checking by returning NaN's is dumb, this should return a bool
- * and have the result in an argument passed by ref. Or, if you wanna look cool
- * at all the C++ parties, return a std::optional. 
+ * Entry point for `ivs rankmap`, same deal as stipple_main.
  */
-vec2 circumcircle_center(vec2 c0, vec2 c1, vec2 c2);
+int rank_map_main(int argc, char **argv);
 
 /**
- * Utility functions to turn points from the internal Delaunay triangulation
- * structure into regular vec2's.
+ * Entry point for `ivs batch`, same deal as stipple_main.
  */
-vec2 point(const PDT &trig, const PDT::Periodic_point pnt);
-vec2 point(const PDT &trig, const PDT::Vertex_handle pnt);
+int batch_main(int argc, char **argv);
 
 /**
- * Draw a triangulation using the options in opts and save the drawing to a
- * file. Mostly used for debugging and fancy GitHub gifs. 
+ * Entry point for `ivs analyze`, same deal as stipple_main.
  */
-void draw_trig(const char *file, const PDT &trig);
+int analyze_main(int argc, char **argv);
@@ -20,6 +20,7 @@
 #include "main.hpp"
 
 #include <getopt.h>
+#include <algorithm>
 
 options opts;
 
@@ -29,21 +30,42 @@ void print_help()
     std::cout << R"HELP(Incremental voronoi set generator
 
 Usage: ivs [options] [<output-file>]
+       ivs stipple [options] <points> <image> <output>
+       ivs rankmap [options] <points> <output>
+       ivs batch [options] <jobs>
+       ivs analyze [options] <points>
 	
 The <output-file> option is a file to save the finished IVS set into. Each line
 will have the X and Y coordinates of the dot (in the range [0,1)) separated by a
-comma. If <output-file> is a "-", then print to stdout instead. 
+comma (unless one of the binary formats is chosen with --format). If
+<output-file> is a "-", then print to stdout instead. 
+
+The stipple command stipples an image with a generated set, and the rankmap
+command bakes one into a threshold texture, see ivs stipple --help and
+ivs rankmap --help. The batch command generates lots of sets at once, see
+ivs batch --help, and the analyze command measures the spectrum and spacing
+of one, see ivs analyze --help.
 
 Options:
     -h, --help                  Print this help text
 
     -n, --number                Number of total points to generate
         --seed <n>              Seed for RNG
-    -c, --seed-count <n>        Number of initial seed points (default = 2)
+    -c, --seed-count <n>        Number of initial seed points (default = 3)
+        --resume <file>         Continue a set from an earlier run (a point
+                                file in any format) instead of starting from
+                                new seeds. The output is the whole set, and
+                                it's the same as if it had been generated in
+                                one go (except from binary32 files, which
+                                have lost some precision). --seed and
+                                --seed-count come from the file's header,
+                                if it has one
 
     -f, --draw-final <file>     Save final image to file
     -i, --draw-inter <files>    Save intermediate images to file
                                 Example: ivs_%07d.png
+        --inter-stride <k>      Only save every k:th intermediate image (and
+                                the last one)
 
         --draw-voronoi          Draw the voronoi diagram
         --draw-delaunay         Draw the Delaunay triangulation
@@ -53,6 +75,59 @@ Options:
     -l, --line-width <n>        Width a drawn line
     -o, --img-size <n>          Saved images size (output images are square, this
                                 is the size of one side)
+
+        --format <fmt>          Format of <output-file>, one of:
+                                  text      "x,y" per line (default)
+                                  binary    little-endian header followed by
+                                            packed double x,y pairs
+                                  binary32  same as binary, but with floats
+
+        --engine <engine>       Triangulation to use, one of:
+                                  cgal      CGAL's periodic triangulation
+                                            (default)
+                                  compact   smaller and faster, produces the
+                                            same points as cgal
+                                  tiled     approximate: an exact prefix,
+                                            then tiles generated in parallel,
+                                            for really big sets
+        --tiles <n>             Tiles on each side for --engine tiled (even,
+                                at most 1448, default 8). The points depend
+                                on this, but not on the number of threads
+        --queue <queue>         Priority queue to use, one of:
+                                  heap      4-ary addressable heap (default)
+                                  bucket    buckets on the circle size, faster
+                                            for big sets, produces the same
+                                            points as heap
+    -j, --threads <n>           Number of threads (default 1, 0 = one per
+                                core). Only used by the compact and tiled
+                                engines and --cells, and the points are the
+                                same no matter how many there are
+
+        --stats <file>          Write timings and counters for the generator
+                                to <file> as JSON ("-" for stderr)
+        --index <file>          Also write an index of the set to <file>, for
+                                finding the points with rank < k in a region
+                                quickly (see point_index.hpp)
+        --cells <file>          Also write the area of the Voronoi cell of
+                                every point to <file>, by rank (see
+                                voronoi_cells.hpp)
+        --cell-neighbors        Put the Delaunay neighbors of every point in
+                                the --cells file too
+        --emit-at <counts>      Comma separated point counts to also save the
+                                set at, e.g. 1024,4096,16384. Every file
+                                (output, final image, stats) gets a copy for
+                                each count, named like points-1024.txt. All
+                                from the same run, since every prefix of an
+                                IVS is an IVS
+        --cache <dir>           Keep generated sets in <dir> and reuse them:
+                                a set that's already there (with at least as
+                                many points) is read instead of generated, and
+                                a smaller one is continued from. Only depends
+                                on --seed and --seed-count, and is safe to
+                                share between processes. Not used with
+                                --engine tiled
+        --cache-size <MiB>      Delete the least recently used sets when the
+                                cache gets bigger than this (default 1024)
 )HELP";
 }
 
@@ -65,18 +140,35 @@ bool parse_options(int argc, char **argv) {
         { "number",             required_argument, 0, 'n' },
         { "seed",               required_argument, 0, 'e' },
         { "seed-count",         required_argument, 0, 'c' },
+        { "resume",             required_argument, 0, 'r' },
         { "draw-final",         required_argument, 0, 'f' },
         { "draw-inter",         required_argument, 0, 'i' },
-        { "draw-voronoi",       no_argument,       &(opts.draw_voronoi), 1 },  
-        { "draw-delaunay",      no_argument,       &(opts.draw_triangulation), 1 },  
-        { "draw-circumcircles", no_argument,       &(opts.draw_circumcircles), 1 },  
+        { "inter-stride",       required_argument, 0, 'k' },
+        { "draw-voronoi",       no_argument,       &(opts.draw.draw_voronoi), 1 },  
+        { "draw-delaunay",      no_argument,       &(opts.draw.draw_triangulation), 1 },  
+        { "draw-circumcircles", no_argument,       &(opts.draw.draw_circumcircles), 1 },  
         { "point-size",         required_argument, 0, 'p' },
         { "line-width",         required_argument, 0, 'l' },
         { "img-size",           required_argument, 0, 'o' },
+        { "format",             required_argument, 0, 't' },
+        { "engine",             required_argument, 0, 'g' },
+        { "queue",              required_argument, 0, 'u' },
+        { "threads",            required_argument, 0, 'j' },
+        { "tiles",              required_argument, 0, 'T' },
+        { "stats",              required_argument, 0, 'S' },
+        { "index",              required_argument, 0, 'x' },
+        { "cells",              required_argument, 0, 'V' },
+        { "cell-neighbors",     no_argument,       &(opts.cell_neighbors), 1 },
+        { "emit-at",            required_argument, 0, 'a' },
+        { "cache",              required_argument, 0, 'D' },
+        { "cache-size",         required_argument, 0, 'M' },
         { 0, 0, 0, 0 }
     };
 
-    const char *shortopts = "hvsn:c:f:i:p:l:o:";
+    const char *shortopts = "hvsn:c:f:i:p:l:o:j:";
+
+    // The header of the --resume file, if it has one
+    point_file_header resume_header { 0, 0, 0 };
 
     while(1) {
         int optindex;
@@ -91,7 +183,14 @@ bool parse_options(int argc, char **argv) {
 
         case 'n':
             try {
-                opts.point_count = std::stoi(optarg);
+                auto count = std::stoll(optarg);
+
+                if (count < 1 || count > MAX_POINT_COUNT) {
+                    std::cerr << "Point count should be between 1 and " << MAX_POINT_COUNT << std::endl;
+                    return false;
+                }
+
+                opts.point_count = (uint32_t)count;
             } catch (...) {
                 std::cerr << "Failed to parse point-count" << std::endl;
                 return false;
@@ -122,6 +221,33 @@ bool parse_options(int argc, char **argv) {
             }
             break;
 
+        case 'r': {
+            // Read it right away, in case it's the same file as the output
+            // (which gets truncated when it's opened below)
+            if (!read_points(optarg, opts.resume_points, &resume_header)) {
+                return false;
+            }
+
+            if (opts.resume_points.empty()) {
+                std::cerr << optarg << " doesn't have any points" << std::endl;
+                return false;
+            }
+
+            // Everything downstream assumes the unit torus. Point k is on
+            // line k of a text file.
+            for (size_t i = 0; i < opts.resume_points.size(); i++) {
+                auto p = opts.resume_points[i];
+
+                if (!(p.x >= 0 && p.x < 1 && p.y >= 0 && p.y < 1)) {
+                    std::cerr << optarg << ": point " << i + 1 << " (" << p.x << ", " << p.y
+                              << ") is outside [0, 1)" << std::endl;
+                    return false;
+                }
+            }
+
+            break;
+        }
+
         case 'f':
             opts.final_name = std::string(optarg);
             break;
@@ -130,9 +256,23 @@ bool parse_options(int argc, char **argv) {
             opts.inter_format = std::string(optarg);
             break;
 
+        case 'k':
+            try {
+                opts.inter_stride = std::stoul(optarg);
+
+                if (opts.inter_stride < 1) {
+                    std::cerr << "Intermediate stride should be >= 1" << std::endl;
+                    return false;
+                }
+            } catch (...) {
+                std::cerr << "Failed to parse intermediate stride" << std::endl;
+                return false;
+            }
+            break;
+
         case 'p':
             try {
-                opts.point_size = std::stof(optarg);
+                opts.draw.point_size = std::stof(optarg);
             } catch (...) {
                 std::cerr << "Failed to parse point size" << std::endl;
                 return false;
@@ -141,7 +281,7 @@ bool parse_options(int argc, char **argv) {
 
         case 'l':
             try {
-                opts.line_width = std::stof(optarg);
+                opts.draw.line_width = std::stof(optarg);
             } catch (...) {
                 std::cerr << "Failed to parse line width" << std::endl;
                 return false;
@@ -150,24 +290,149 @@ bool parse_options(int argc, char **argv) {
 
         case 'o':
             try {
-                opts.img_size = std::stoul(optarg);
+                opts.draw.img_size = std::stoul(optarg);
             } catch (...) {
                 std::cerr << "Failed to parse image size" << std::endl;
                 return false;
             }
             break;
+
+        case 't':
+            if (!parse_point_format(optarg, opts.output_format)) {
+                std::cerr << "Unknown output format: " << optarg << std::endl;
+                return false;
+            }
+            break;
+
+        case 'g':
+            if (!parse_engine(optarg, opts.engine)) {
+                std::cerr << "Unknown engine: " << optarg << std::endl;
+                return false;
+            }
+            break;
+
+        case 'u':
+            if (!parse_queue(optarg, opts.queue)) {
+                std::cerr << "Unknown queue: " << optarg << std::endl;
+                return false;
+            }
+            break;
+
+        case 'j':
+            try {
+                opts.threads = std::stoul(optarg);
+            } catch (...) {
+                std::cerr << "Failed to parse thread count" << std::endl;
+                return false;
+            }
+            break;
+
+        case 'T':
+            try {
+                auto tiles = std::stoul(optarg);
+
+                if (tiles < 2 || tiles % 2 != 0 || tiles > MAX_TILES) {
+                    std::cerr << "Tile count should be even, >= 2 and <= " << MAX_TILES << std::endl;
+                    return false;
+                }
+
+                opts.tiles = (uint32_t)tiles;
+            } catch (...) {
+                std::cerr << "Failed to parse tile count" << std::endl;
+                return false;
+            }
+            break;
+
+        case 'x':
+            opts.index_file = std::string(optarg);
+            break;
+
+        case 'V':
+            opts.cells_file = std::string(optarg);
+            break;
+
+        case 'S':
+#if IVS_STATS
+            opts.stats_file = std::string(optarg);
+#else
+            std::cerr << "This build doesn't have stats (IVS_STATS is off)" << std::endl;
+            return false;
+#endif
+            break;
             
+        case 'a': {
+            std::stringstream list { optarg };
+            std::string count;
+
+            while (std::getline(list, count, ',')) {
+                try {
+                    opts.emit_at.push_back(std::stoul(count));
+                } catch (...) {
+                    std::cerr << "Failed to parse emit-at count: " << count << std::endl;
+                    return false;
+                }
+            }
+            break;
+        }
+
+        case 'D':
+            opts.cache_dir = std::string(optarg);
+            break;
+
+        case 'M':
+            try {
+                opts.cache_size = (uint64_t)std::stoull(optarg) << 20;
+            } catch (...) {
+                std::cerr << "Failed to parse cache size" << std::endl;
+                return false;
+            }
+            break;
+
         case '?':
             return false;
         }
     }
 
+    // Keep the seed info of a binary --resume file for the header of the
+    // output. The points came from that seed, whatever --seed and -c say
+    // (before or after --resume).
+    if (resume_header.seed_count != 0) {
+        opts.rng_seed = resume_header.rng_seed;
+        opts.seed_count = resume_header.seed_count;
+    }
+
+    // The whole set is written as usual, so a snapshot of all of it would
+    // just be a copy
+    std::sort(opts.emit_at.begin(), opts.emit_at.end());
+    opts.emit_at.erase(std::unique(opts.emit_at.begin(), opts.emit_at.end()), opts.emit_at.end());
+
+    if (!opts.emit_at.empty() && opts.emit_at.front() < 1) {
+        std::cerr << "Can't snapshot 0 points, emit-at counts have to be at least 1" << std::endl;
+        return false;
+    }
+
+    while (!opts.emit_at.empty() && opts.emit_at.back() >= opts.point_count) {
+        if (opts.emit_at.back() > opts.point_count) {
+            std::cerr << "Can't snapshot " << opts.emit_at.back() << " points of a "
+                << opts.point_count << " point set" << std::endl;
+            return false;
+        }
+
+        opts.emit_at.pop_back();
+    }
+
     if (optind < argc) {
+        opts.output_file = argv[optind];
+
         if (strcmp("-", argv[optind]) == 0) {
             opts.output = std::make_unique<std::ostream>(std::cout.rdbuf());
         } else {
-            opts.output = std::make_unique<std::ofstream>(argv[optind]);
+            opts.output = std::make_unique<std::ofstream>(
+                argv[optind], std::ios::out | std::ios::binary);
         }
+
+        point_file_header header { opts.point_count, opts.rng_seed, opts.seed_count };
+        opts.writer = make_point_writer(opts.output_format, *opts.output, header);
     }
 
     return true;
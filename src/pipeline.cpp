@@ -0,0 +1,214 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The output pipeline. Writing the points and (especially) drawing the
+ * intermediate frames used to happen right in the middle of the generator loop,
+ * so with --draw-inter the generator spent nearly all its time waiting for
+ * Cairo. Now the generator just pushes every point into a lock-free ring buffer
+ * per consumer (see spsc_ring.hpp), and the consumers do their thing on their
+ * own threads.
+ *
+ * The frame renderer doesn't look at the generator's triangulation at all
+ * (which would need locking, and wouldn't even work for the compact engine):
+ * it builds its own copy by inserting the points as they come in, and draws
+ * that (see frame_renderer in drawer.cpp). Since the triangulation of a set of points doesn't depend on the
+ * insertion order, frame i looks exactly the same as if it had been drawn from
+ * the real thing.
+ *
+ * If a consumer falls behind (the renderer always does), the rings fill up.
+ * Instead of waiting, the generator then parks the points in a plain vector
+ * and moves them over whenever there's room again, so it never blocks. The
+ * only place it waits is finish(), when there's nothing left to generate.
+ */
+
+#include "pipeline.hpp"
+
+/**
+ * Points per ring.
+ */
+static const size_t RING_SIZE = 1 << 16;
+
+point_pipeline::lane::lane()
+	: ring { RING_SIZE }
+	, pending_head { 0 }
+	, done { false }
+{
+}
+
+void point_pipeline::lane::flush_pending()
+{
+	while (pending_head < pending.size() && ring.push(pending[pending_head])) {
+		pending_head++;
+	}
+
+	if (pending_head == pending.size()) {
+		pending.clear();
+		pending_head = 0;
+	} else if (pending_head >= RING_SIZE && pending_head >= pending.size() / 2) {
+		// A consumer that's always behind (like the frames) never lets the
+		// backlog empty out completely, so drop what's already been moved
+		// over once it's at least half the vector. Every item is moved at
+		// most once more on average, and pending stays within twice the
+		// backlog.
+		pending.erase(pending.begin(), pending.begin() + pending_head);
+		pending_head = 0;
+	}
+}
+
+void point_pipeline::lane::push(const item &it)
+{
+	// Things have to come out in order, so nothing can go in the ring while
+	// there's stuff waiting
+	if (!pending.empty()) {
+		flush_pending();
+	}
+
+	if (!pending.empty() || !ring.push(it)) {
+		pending.push_back(it);
+	}
+}
+
+point_pipeline::point_pipeline(const ivs_config &config, const point_callback &callback)
+	: config { config }
+	, callback { callback }
+	, finished { false }
+{
+	if (callback) {
+		output = std::make_unique<lane>();
+		output->thread = std::thread { [this] { output_main(); } };
+	}
+
+	if (config.inter_format != "") {
+		frames = std::make_unique<lane>();
+		frames->thread = std::thread { [this] { frames_main(); } };
+	}
+}
+
+point_pipeline::~point_pipeline()
+{
+	try {
+		finish();
+	} catch (...) {
+	}
+}
+
+void point_pipeline::publish(uint32_t index, vec2 point, bool draw)
+{
+	item it { point, index, draw };
+
+	if (output) output->push(it);
+	if (frames) frames->push(it);
+}
+
+void point_pipeline::finish()
+{
+	if (finished) return;
+	finished = true;
+
+	for (auto l : { output.get(), frames.get() }) {
+		if (!l) continue;
+
+		while (!l->pending.empty()) {
+			l->flush_pending();
+			std::this_thread::yield();
+		}
+
+		l->done.store(true, std::memory_order_release);
+	}
+
+	for (auto l : { output.get(), frames.get() }) {
+		if (l) l->thread.join();
+	}
+
+	for (auto l : { output.get(), frames.get() }) {
+		if (l && l->error) std::rethrow_exception(l->error);
+	}
+}
+
+/**
+ * Pop items off a lane and hand them to handle until the producer is done and
+ * the ring is empty. When there's nothing to do, it backs off to short sleeps
+ * so an idle consumer doesn't eat a core.
+ */
+template <typename Handler>
+void point_pipeline::consume(lane &l, Handler handle)
+{
+	item it;
+	uint32_t idle = 0;
+
+	while (true) {
+		if (l.ring.pop(it)) {
+			idle = 0;
+			handle(it);
+		} else if (l.done.load(std::memory_order_acquire)) {
+			// Everything pushed before done is visible now, so one more go
+			// and we're really finished.
+			if (!l.ring.pop(it)) break;
+			handle(it);
+		} else if (idle < 64) {
+			idle++;
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+	}
+}
+
+void point_pipeline::output_main()
+{
+	bool failed = false;
+
+	consume(*output, [&](const item &it) {
+		if (failed) return;
+
+		try {
+			callback(it.index, it.point);
+		} catch (...) {
+			// Keep draining so the generator isn't left hanging, the
+			// exception comes out in finish
+			output->error = std::current_exception();
+			failed = true;
+		}
+	});
+}
+
+void point_pipeline::frames_main()
+{
+	std::unique_ptr<frame_renderer> renderer;
+
+	try {
+		renderer = std::make_unique<frame_renderer>(config);
+	} catch (...) {
+		frames->error = std::current_exception();
+	}
+
+	consume(*frames, [&](const item &it) {
+		if (!renderer) return;
+
+		try {
+			renderer->add_point(it.index, it.point, it.draw);
+		} catch (...) {
+			// Same as output_main, drop the renderer and keep draining
+			frames->error = std::current_exception();
+			renderer.reset();
+		}
+	});
+}
@@ -0,0 +1,112 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Moving the output and the intermediate frames off the generator thread. See
+ * pipeline.cpp.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+#include "spsc_ring.hpp"
+
+#include <atomic>
+#include <exception>
+#include <thread>
+
+/**
+ * Takes the points from the generator and hands them to background threads:
+ * one calls the point callback, and one renders the intermediate frames from
+ * its own copy of the triangulation. The generator only ever pushes points into
+ * a couple of ring buffers, so it never waits for I/O or Cairo.
+ */
+class point_pipeline
+{
+public:
+	/**
+	 * Starts a thread for the callback (if there is one) and for the frames
+	 * (if config.inter_format is set).
+	 */
+	point_pipeline(const ivs_config &config, const point_callback &callback);
+
+	/**
+	 * Finishes, but swallows any exceptions. Call finish if you care.
+	 */
+	~point_pipeline();
+
+	/**
+	 * Hand over the next point of the set. If draw is false, no frame is drawn
+	 * for it (the point still goes into the triangulation, of course). Never
+	 * blocks.
+	 */
+	void publish(uint32_t index, vec2 point, bool draw = true);
+
+	/**
+	 * Wait for the threads to get through everything that's been published,
+	 * and stop them. If the callback or a frame threw, that exception is
+	 * rethrown here.
+	 */
+	void finish();
+
+private:
+	struct item {
+		vec2 point;
+		uint32_t index;
+		uint32_t draw;
+	};
+
+	/**
+	 * A consumer thread and the ring feeding it. Whatever doesn't fit in the
+	 * ring waits in pending (on the producer's side) until there's room. The
+	 * items before pending_head have already gone into the ring, and are
+	 * dropped once they're half of pending (and more than a ring's worth), so
+	 * pending holds at most about twice the backlog, not every point that
+	 * ever waited. If the consumer throws, it keeps the exception in error
+	 * and goes on draining without handling anything.
+	 */
+	struct lane {
+		spsc_ring<item> ring;
+		std::vector<item> pending;
+		size_t pending_head;
+		std::atomic<bool> done;
+		std::thread thread;
+		std::exception_ptr error;
+
+		lane();
+
+		void push(const item &it);
+		void flush_pending();
+	};
+
+	const ivs_config &config;
+	point_callback callback;
+
+	std::unique_ptr<lane> output;
+	std::unique_ptr<lane> frames;
+
+	bool finished;
+
+	template <typename Handler>
+	void consume(lane &l, Handler handle);
+
+	void output_main();
+	void frames_main();
+};
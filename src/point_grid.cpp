@@ -0,0 +1,124 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "point_grid.hpp"
+
+point_grid::point_grid(const std::vector<vec2> &points, uint32_t side)
+	: cells_per_side { side }
+{
+	if (cells_per_side == 0) {
+		// About four points per cell
+		cells_per_side = std::max<uint32_t>(1, (uint32_t)std::sqrt(points.size() / 4.0));
+	}
+
+	size_t cell_count = (size_t)cells_per_side * cells_per_side;
+
+	std::vector<uint32_t> cell_of(points.size());
+	starts.assign(cell_count + 1, 0);
+
+	for (size_t i = 0; i < points.size(); i++) {
+		cell_of[i] = cell(points[i].y) * cells_per_side + cell(points[i].x);
+		starts[cell_of[i] + 1]++;
+	}
+
+	for (size_t c = 0; c < cell_count; c++) {
+		starts[c + 1] += starts[c];
+	}
+
+	xs.resize(points.size());
+	ys.resize(points.size());
+	ranks.resize(points.size());
+
+	std::vector<uint32_t> fill(starts.begin(), starts.end() - 1);
+
+	for (size_t i = 0; i < points.size(); i++) {
+		auto k = fill[cell_of[i]]++;
+
+		xs[k] = (float)points[i].x;
+		ys[k] = (float)points[i].y;
+		ranks[k] = (uint32_t)i;
+	}
+}
+
+/**
+ * Start with the cell (u, v) is in, and look at rings of cells further and
+ * further out until the ring is further away than the best point found so far.
+ * Since an IVS is so evenly spread out, that's almost always done after the
+ * first ring.
+ */
+uint32_t point_grid::nearest(double u, double v, uint32_t skip) const
+{
+	int64_t side = cells_per_side;
+	int64_t cx = cell(u);
+	int64_t cy = cell(v);
+	double cell_size = 1.0 / side;
+
+	double best_d2 = std::numeric_limits<double>::infinity();
+	uint32_t best_rank = NO_POINT;
+
+	auto visit = [&](int64_t gx, int64_t gy) {
+		gx = (gx % side + side) % side;
+		gy = (gy % side + side) % side;
+
+		auto kb = begin((uint32_t)gx, (uint32_t)gy);
+		auto ke = end((uint32_t)gx, (uint32_t)gy);
+
+		for (auto k = kb; k < ke; k++) {
+			if (ranks[k] == skip) continue;
+
+			double dx = xs[k] - u;
+			double dy = ys[k] - v;
+
+			dx -= std::round(dx);
+			dy -= std::round(dy);
+
+			double d2 = dx * dx + dy * dy;
+
+			if (d2 < best_d2 || (d2 == best_d2 && ranks[k] < best_rank)) {
+				best_d2 = d2;
+				best_rank = ranks[k];
+			}
+		}
+	};
+
+	for (int64_t r = 0; r <= side / 2 + 1; r++) {
+		if (r == 0) {
+			visit(cx, cy);
+		} else {
+			for (int64_t d = -r; d <= r; d++) {
+				visit(cx + d, cy - r);
+				visit(cx + d, cy + r);
+			}
+
+			for (int64_t d = -r + 1; d <= r - 1; d++) {
+				visit(cx - r, cy + d);
+				visit(cx + r, cy + d);
+			}
+		}
+
+		// Everything in the next ring is at least this far away. Has to be
+		// strictly further, or a tie with a lower rank might be out there.
+		double next = r * cell_size;
+
+		if (best_d2 < next * next) break;
+	}
+
+	return best_rank;
+}
@@ -0,0 +1,84 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * A uniform grid over the unit square, for finding the points of a set that are
+ * in some region without looking at all of them, or the one closest to a
+ * spot. Used by the renderers, the rank maps and the analysis.
+ *
+ * The points are bucketed with a counting sort, so within each cell they're
+ * still in rank order (i.e. the order they were generated in). The cells are
+ * stored back to back in plain arrays (x, y and rank separately), so looping
+ * over a cell or a row of cells is just looping over a slice of an array.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+class point_grid
+{
+public:
+	/**
+	 * Bucket points (which should be in [0,1)x[0,1)) into a grid with side
+	 * cells per side. Zero picks a size with a few points per cell.
+	 */
+	explicit point_grid(const std::vector<vec2> &points, uint32_t side = 0);
+
+	uint32_t side() const { return cells_per_side; }
+	size_t size() const { return xs.size(); }
+
+	/**
+	 * The cell a coordinate in [0,1) falls in.
+	 */
+	uint32_t cell(double v) const
+	{
+		auto c = (int64_t)(v * cells_per_side);
+		return (uint32_t)std::clamp<int64_t>(c, 0, cells_per_side - 1);
+	}
+
+	/**
+	 * The points in cells [cx0, cx1] on row cy are the ones in
+	 * [begin(cx0, cy), end(cx1, cy)).
+	 */
+	uint32_t begin(uint32_t cx, uint32_t cy) const { return starts[cy * cells_per_side + cx]; }
+	uint32_t end(uint32_t cx, uint32_t cy) const { return starts[cy * cells_per_side + cx + 1]; }
+
+	/**
+	 * Rank of the point closest to (u, v), wrapping around the edges, leaving
+	 * out the point of rank skip (if there is one). Ties go to the lower rank,
+	 * so the answer doesn't depend on the order anything is looked at in.
+	 * NO_POINT if there's nothing to find.
+	 */
+	static constexpr uint32_t NO_POINT = std::numeric_limits<uint32_t>::max();
+	uint32_t nearest(double u, double v, uint32_t skip = NO_POINT) const;
+
+	float x(uint32_t k) const { return xs[k]; }
+	float y(uint32_t k) const { return ys[k]; }
+	uint32_t rank(uint32_t k) const { return ranks[k]; }
+
+private:
+	uint32_t cells_per_side;
+
+	std::vector<uint32_t> starts;
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<uint32_t> ranks;
+};
@@ -0,0 +1,204 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "point_index.hpp"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char INDEX_MAGIC[4] = { 'I', 'V', 'S', 'I' };
+static const uint32_t INDEX_VERSION = 1;
+static const uint32_t INDEX_BYTE_ORDER = 0x01020304;
+
+/**
+ * Size of an index file with these numbers in the header.
+ */
+static uint64_t index_size(uint64_t point_count, uint64_t side)
+{
+	return sizeof(point_index_header)
+		+ (side * side + 1) * sizeof(uint32_t)
+		+ point_count * sizeof(indexed_point);
+}
+
+bool write_point_index(const std::string &file, const point_grid &grid)
+{
+	std::ofstream out { file, std::ios::out | std::ios::binary };
+
+	if (!out) {
+		std::cerr << "Failed to open " << file << std::endl;
+		return false;
+	}
+
+	auto side = grid.side();
+
+	point_index_header header;
+	memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+	header.version = INDEX_VERSION;
+	header.byte_order = INDEX_BYTE_ORDER;
+	header.point_count = (uint32_t)grid.size();
+	header.side = side;
+	header.reserved = 0;
+
+	out.write((const char *)&header, sizeof(header));
+
+	// The grid already has the cells in the right order
+	std::vector<uint32_t> starts;
+	starts.reserve((size_t)side * side + 1);
+
+	for (uint32_t cy = 0; cy < side; cy++) {
+		for (uint32_t cx = 0; cx < side; cx++) {
+			starts.push_back(grid.begin(cx, cy));
+		}
+	}
+
+	starts.push_back((uint32_t)grid.size());
+
+	out.write((const char *)starts.data(), starts.size() * sizeof(uint32_t));
+
+	std::vector<indexed_point> points(grid.size());
+
+	for (uint32_t k = 0; k < grid.size(); k++) {
+		points[k] = indexed_point { grid.x(k), grid.y(k), grid.rank(k) };
+	}
+
+	out.write((const char *)points.data(), points.size() * sizeof(indexed_point));
+	out.flush();
+
+	if (!out) {
+		std::cerr << "Failed to write " << file << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+point_index::point_index()
+	: data { nullptr }
+	, length { 0 }
+	, header { nullptr }
+	, starts { nullptr }
+	, points { nullptr }
+{
+}
+
+point_index::~point_index()
+{
+	close();
+}
+
+bool point_index::open(const char *file)
+{
+	close();
+
+	int fd = ::open(file, O_RDONLY);
+
+	if (fd < 0) {
+		std::cerr << "Failed to open " << file << std::endl;
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(point_index_header)) {
+		std::cerr << file << " is not an index file" << std::endl;
+		::close(fd);
+		return false;
+	}
+
+	auto mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	// The mapping keeps the file alive, we don't need the descriptor
+	::close(fd);
+
+	if (mapped == MAP_FAILED) {
+		std::cerr << "Failed to map " << file << std::endl;
+		return false;
+	}
+
+	data = mapped;
+	length = (size_t)st.st_size;
+
+	auto h = (const point_index_header *)data;
+
+	if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0) {
+		std::cerr << file << " is not an index file" << std::endl;
+		close();
+		return false;
+	}
+
+	if (h->version != INDEX_VERSION || h->byte_order != INDEX_BYTE_ORDER) {
+		std::cerr << file << " is an index from an incompatible version or machine" << std::endl;
+		close();
+		return false;
+	}
+
+	if (h->side == 0 || length != index_size(h->point_count, h->side)) {
+		std::cerr << file << " is truncated or corrupt" << std::endl;
+		close();
+		return false;
+	}
+
+	header = h;
+	starts = (const uint32_t *)(h + 1);
+	points = (const indexed_point *)(starts + (size_t)h->side * h->side + 1);
+
+	// Make sure the cells are all inside the file, so that nothing we hand
+	// out later points outside it
+	bool sorted = starts[0] == 0 && starts[(size_t)h->side * h->side] == h->point_count;
+
+	for (size_t c = 0; sorted && c < (size_t)h->side * h->side; c++) {
+		sorted = starts[c] <= starts[c + 1];
+	}
+
+	if (!sorted) {
+		std::cerr << file << " is truncated or corrupt" << std::endl;
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void point_index::close()
+{
+	if (data) {
+		munmap(data, length);
+	}
+
+	data = nullptr;
+	length = 0;
+	header = nullptr;
+	starts = nullptr;
+	points = nullptr;
+}
+
+point_span point_index::prefix(uint32_t cx, uint32_t cy, uint32_t k) const
+{
+	auto span = cell(cx, cy);
+
+	// The cell is sorted by rank, so the points below k are a prefix of it
+	auto last = std::lower_bound(span.first, span.last, k,
+		[](const indexed_point &p, uint32_t k) { return p.rank < k; });
+
+	return point_span { span.first, last };
+}
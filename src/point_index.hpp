@@ -0,0 +1,184 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Index files: a set bucketed into a uniform grid over the torus, with the
+ * points of every cell sorted by rank, written so that it can be memory mapped
+ * and used right off the disk.
+ *
+ * What you usually want from a set when stippling is "every point with rank
+ * less than k in this rectangle", for lots of different rectangles and k's.
+ * With the index, that's a binary search in each cell the rectangle touches
+ * (since the cells are sorted by rank, the points with rank < k are a prefix of
+ * the cell), and the result is just pointers into the mapped file. Nothing is
+ * copied or even read until you look at it.
+ *
+ * The layout is:
+ *
+ *   point_index_header
+ *   uint32_t starts[side * side + 1]   where each cell starts, cells row by row
+ *   indexed_point points[point_count]  the points, cell by cell
+ *
+ * All in native byte order (the header has a marker to check that it matches),
+ * and everything is 4-byte aligned.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+#include "point_grid.hpp"
+
+struct point_index_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t point_count;
+	uint32_t side;
+	uint32_t reserved;
+};
+
+struct indexed_point {
+	float x;
+	float y;
+	uint32_t rank;
+};
+
+static_assert(sizeof(point_index_header) == 24, "The header is part of the file format");
+static_assert(sizeof(indexed_point) == 12, "Points are part of the file format");
+
+/**
+ * Write an index of a set to a file. Returns false (after complaining to
+ * stderr) if that didn't work.
+ */
+bool write_point_index(const std::string &file, const point_grid &grid);
+
+/**
+ * A slice of the points in an index.
+ */
+struct point_span {
+	const indexed_point *first;
+	const indexed_point *last;
+
+	const indexed_point *begin() const { return first; }
+	const indexed_point *end() const { return last; }
+	size_t size() const { return (size_t)(last - first); }
+	bool empty() const { return first == last; }
+};
+
+/**
+ * Reads an index file by mapping it into memory.
+ */
+class point_index
+{
+public:
+	point_index();
+	~point_index();
+
+	point_index(const point_index&) = delete;
+	point_index &operator=(const point_index&) = delete;
+
+	/**
+	 * Map an index file. Returns false (after complaining to stderr) if it
+	 * can't be opened or isn't an index.
+	 */
+	bool open(const char *file);
+
+	/**
+	 * Unmap the file. Any spans you got from it are dead after this.
+	 */
+	void close();
+
+	uint32_t side() const { return header ? header->side : 0; }
+	size_t size() const { return header ? header->point_count : 0; }
+
+	/**
+	 * All points of cell (cx, cy), sorted by rank.
+	 */
+	point_span cell(uint32_t cx, uint32_t cy) const
+	{
+		auto c = (size_t)cy * header->side + cx;
+		return point_span { points + starts[c], points + starts[c + 1] };
+	}
+
+	/**
+	 * The points of cell (cx, cy) with rank less than k.
+	 */
+	point_span prefix(uint32_t cx, uint32_t cy, uint32_t k) const;
+
+	/**
+	 * Call fn(span, shift) for every cell that overlaps the rectangle
+	 * [min, max], with the span of points in the cell with rank less than k.
+	 * The rectangle can stick out of the unit square (or be bigger than it),
+	 * it wraps around: shift is the whole number offset to add to the points
+	 * of the span to put them in the rectangle's coordinates. The cells along
+	 * the edges might have points that aren't in the rectangle, use
+	 * for_each_point if you want it exact.
+	 */
+	template <typename Fn>
+	void for_each_cell(vec2 min, vec2 max, uint32_t k, Fn &&fn) const
+	{
+		if (!header || !(min.x <= max.x && min.y <= max.y)) return;
+
+		int64_t side = header->side;
+
+		auto first = [&](double v) { return (int64_t)std::floor(v * side); };
+		auto wrap = [&](int64_t c) { return ((c % side) + side) % side; };
+
+		for (int64_t cy = first(min.y); cy <= first(max.y); cy++) {
+			auto wy = wrap(cy);
+
+			for (int64_t cx = first(min.x); cx <= first(max.x); cx++) {
+				auto wx = wrap(cx);
+				auto span = prefix((uint32_t)wx, (uint32_t)wy, k);
+
+				if (!span.empty()) {
+					fn(span, vec2 { (double)((cx - wx) / side), (double)((cy - wy) / side) });
+				}
+			}
+		}
+	}
+
+	/**
+	 * Call fn(point, rank) for every point with rank less than k that is in
+	 * [min, max) (wrapping around like for_each_cell, with the point moved
+	 * into the rectangle's coordinates).
+	 */
+	template <typename Fn>
+	void for_each_point(vec2 min, vec2 max, uint32_t k, Fn &&fn) const
+	{
+		for_each_cell(min, max, k, [&](point_span span, vec2 shift) {
+			for (const auto &p : span) {
+				vec2 q { p.x + shift.x, p.y + shift.y };
+
+				if (q.x >= min.x && q.x < max.x && q.y >= min.y && q.y < max.y) {
+					fn(q, p.rank);
+				}
+			}
+		});
+	}
+
+private:
+	void *data;
+	size_t length;
+
+	const point_index_header *header;
+	const uint32_t *starts;
+	const indexed_point *points;
+};
@@ -0,0 +1,385 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Writers for the point files.
+ *
+ * This used to be a single line in add_point that did `<< std::endl` for every
+ * point, which flushes the stream every single time. That's fine for a few
+ * thousand points, but for millions of points it was a noticable chunk of the
+ * runtime, and the text files get enormous. So now there's a little writer
+ * class that keeps a big buffer and only hands it to the stream when it fills
+ * up.
+ *
+ * There's two formats: text (same format as always, "x,y" per line, but
+ * printed with std::to_chars which is way faster than iostreams and gives the
+ * shortest representation that round-trips exactly) and binary. The binary
+ * format is little-endian and looks like this:
+ *
+ *   offset  size  field
+ *        0     4  magic, "IVSB"
+ *        4     4  format version (currently 1)
+ *        8     4  N, number of points in the file
+ *       12     4  RNG seed used to generate the seed points
+ *       16     4  number of seed points
+ *       20     4  size of each coordinate in bytes (8 = double, 4 = float)
+ *       24   ...  N pairs of x, y coordinates
+ *
+ * The header is 24 bytes so that the coordinates are nicely aligned if you
+ * want to mmap the file.
+ *
+ * There's also a reader at the bottom, for the stuff that consumes the sets
+ * (like the stippler), which reads any of the formats.
+ */
+
+#include "ivs.hpp"
+
+#include <charconv>
+#include <cstring>
+
+point_writer::point_writer(std::ostream &out)
+	: out(out)
+	, buffer(1 << 20)
+	, used(0)
+{
+}
+
+point_writer::~point_writer()
+{
+	// Don't let exceptions escape the destructor, if we're being destroyed
+	// because of a failed write there's not a lot we can do about it anyway.
+	try {
+		flush();
+	} catch (...) {
+	}
+}
+
+void point_writer::flush()
+{
+	if (used > 0) {
+		out.write(buffer.data(), used);
+		used = 0;
+	}
+
+	out.flush();
+}
+
+char *point_writer::reserve(size_t size)
+{
+	if (buffer.size() - used < size) {
+		out.write(buffer.data(), used);
+		used = 0;
+	}
+
+	return buffer.data() + used;
+}
+
+void point_writer::commit(char *end)
+{
+	used = end - buffer.data();
+}
+
+/**
+ * Puts an integer into the buffer as `bytes` little-endian bytes, regardless of
+ * what the host endianess is.
+ */
+static char *put_le(char *dst, uint64_t bits, int bytes)
+{
+	for (int i = 0; i < bytes; i++) {
+		*dst++ = (char)((bits >> (8 * i)) & 0xff);
+	}
+
+	return dst;
+}
+
+/**
+ * Writes points as text, one "x,y" pair per line.
+ */
+class text_point_writer : public point_writer
+{
+public:
+	text_point_writer(std::ostream &out) : point_writer(out) {}
+
+	void write(vec2 point) override
+	{
+		// Shortest round-trip representation of a double is at most 24
+		// characters, so this is plenty.
+		char *dst = reserve(64);
+		char *end = dst + 64;
+
+		dst = std::to_chars(dst, end, point.x).ptr;
+		*dst++ = ',';
+		dst = std::to_chars(dst, end, point.y).ptr;
+		*dst++ = '\n';
+
+		commit(dst);
+	}
+};
+
+/**
+ * Writes points in the binary format, with the coordinates stored as T (either
+ * double or float).
+ */
+template <typename T>
+class binary_point_writer : public point_writer
+{
+	static_assert(sizeof(T) == 4 || sizeof(T) == 8);
+
+	using bits_t = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+
+public:
+	binary_point_writer(std::ostream &out, const point_file_header &header)
+		: point_writer(out)
+	{
+		char *dst = reserve(POINT_FILE_HEADER_SIZE);
+
+		memcpy(dst, "IVSB", 4);
+		dst += 4;
+
+		dst = put_le(dst, POINT_FILE_VERSION, 4);
+		dst = put_le(dst, header.point_count, 4);
+		dst = put_le(dst, header.rng_seed, 4);
+		dst = put_le(dst, header.seed_count, 4);
+		dst = put_le(dst, sizeof(T), 4);
+
+		commit(dst);
+	}
+
+	void write(vec2 point) override
+	{
+		char *dst = reserve(2 * sizeof(T));
+
+		dst = put_le(dst, to_bits(narrow(point.x)), sizeof(T));
+		dst = put_le(dst, to_bits(narrow(point.y)), sizeof(T));
+
+		commit(dst);
+	}
+
+private:
+	/**
+	 * A coordinate as T. Floats round anything within 2^-25 of 1 up to 1,
+	 * which isn't in [0,1) any more (and --resume would feed it back to the
+	 * triangulation outside of its domain), so those get the largest float
+	 * below 1 instead.
+	 */
+	static T narrow(double v)
+	{
+		T t = (T)v;
+		return t < (T)1 ? t : std::nextafter((T)1, (T)0);
+	}
+
+	static bits_t to_bits(T v)
+	{
+		bits_t bits;
+		memcpy(&bits, &v, sizeof(T));
+		return bits;
+	}
+};
+
+std::unique_ptr<point_writer> make_point_writer(
+	point_format format,
+	std::ostream &out,
+	const point_file_header &header)
+{
+	switch (format) {
+	case point_format::text:
+		return std::make_unique<text_point_writer>(out);
+	case point_format::binary:
+		return std::make_unique<binary_point_writer<double>>(out, header);
+	case point_format::binary32:
+		return std::make_unique<binary_point_writer<float>>(out, header);
+	}
+
+	return nullptr;
+}
+
+bool parse_point_format(const std::string &name, point_format &format)
+{
+	if (name == "text") {
+		format = point_format::text;
+	} else if (name == "binary") {
+		format = point_format::binary;
+	} else if (name == "binary32") {
+		format = point_format::binary32;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Reads an integer stored as `bytes` little-endian bytes.
+ */
+static uint64_t get_le(const char *src, int bytes)
+{
+	uint64_t bits = 0;
+
+	for (int i = 0; i < bytes; i++) {
+		bits |= (uint64_t)(uint8_t)src[i] << (8 * i);
+	}
+
+	return bits;
+}
+
+template <typename T>
+static void read_binary_points(const char *src, uint32_t count, std::vector<vec2> &points)
+{
+	using bits_t = std::conditional_t<sizeof(T) == 8, uint64_t, uint32_t>;
+
+	auto get = [&]() {
+		bits_t bits = (bits_t)get_le(src, sizeof(T));
+		src += sizeof(T);
+
+		T v;
+		memcpy(&v, &bits, sizeof(T));
+		return (double)v;
+	};
+
+	points.resize(count);
+
+	for (uint32_t i = 0; i < count; i++) {
+		points[i].x = get();
+		points[i].y = get();
+	}
+}
+
+static bool read_binary_file(
+	const std::string &file,
+	const std::vector<char> &data,
+	std::vector<vec2> &points,
+	point_file_header *header)
+{
+	if (data.size() < POINT_FILE_HEADER_SIZE) {
+		std::cerr << file << ": truncated header" << std::endl;
+		return false;
+	}
+
+	auto version    = (uint32_t)get_le(&data[4], 4);
+	auto count      = (uint32_t)get_le(&data[8], 4);
+	auto coord_size = (uint32_t)get_le(&data[20], 4);
+
+	if (version != POINT_FILE_VERSION) {
+		std::cerr << file << ": unknown point file version " << version << std::endl;
+		return false;
+	}
+
+	if (coord_size != 4 && coord_size != 8) {
+		std::cerr << file << ": bad coordinate size " << coord_size << std::endl;
+		return false;
+	}
+
+	if (data.size() - POINT_FILE_HEADER_SIZE < (uint64_t)count * 2 * coord_size) {
+		std::cerr << file << ": expected " << count << " points, file is too short" << std::endl;
+		return false;
+	}
+
+	if (header) {
+		header->point_count = count;
+		header->rng_seed    = (uint32_t)get_le(&data[12], 4);
+		header->seed_count  = (uint32_t)get_le(&data[16], 4);
+	}
+
+	if (coord_size == 8) {
+		read_binary_points<double>(&data[POINT_FILE_HEADER_SIZE], count, points);
+	} else {
+		read_binary_points<float>(&data[POINT_FILE_HEADER_SIZE], count, points);
+	}
+
+	return true;
+}
+
+static bool read_text_file(
+	const std::string &file,
+	const std::vector<char> &data,
+	std::vector<vec2> &points,
+	point_file_header *header)
+{
+	const char *src = data.data();
+	const char *end = src + data.size();
+
+	points.clear();
+
+	auto skip_space = [&]() {
+		while (src < end && (*src == ' ' || *src == '\t' || *src == '\r' || *src == '\n')) src++;
+	};
+
+	skip_space();
+
+	while (src < end) {
+		vec2 p;
+
+		auto x = std::from_chars(src, end, p.x);
+		auto comma = x.ptr;
+
+		if (x.ec != std::errc() || comma == end || *comma != ',') {
+			std::cerr << file << ": bad point on line " << points.size() + 1 << std::endl;
+			return false;
+		}
+
+		auto y = std::from_chars(comma + 1, end, p.y);
+
+		if (y.ec != std::errc()) {
+			std::cerr << file << ": bad point on line " << points.size() + 1 << std::endl;
+			return false;
+		}
+
+		points.push_back(p);
+
+		src = y.ptr;
+		skip_space();
+	}
+
+	if (header) {
+		header->point_count = (uint32_t)points.size();
+		header->rng_seed    = 0;
+		header->seed_count  = 0;
+	}
+
+	return true;
+}
+
+bool read_points(const std::string &file, std::vector<vec2> &points, point_file_header *header)
+{
+	std::vector<char> data;
+
+	{
+		std::ifstream in;
+		std::istream *stream = &std::cin;
+
+		if (file != "-") {
+			in.open(file, std::ios::in | std::ios::binary);
+
+			if (!in) {
+				std::cerr << "Failed to open " << file << std::endl;
+				return false;
+			}
+
+			stream = &in;
+		}
+
+		data.assign(std::istreambuf_iterator<char>(*stream), std::istreambuf_iterator<char>());
+	}
+
+	if (data.size() >= 4 && memcmp(data.data(), "IVSB", 4) == 0) {
+		return read_binary_file(file, data, points, header);
+	} else {
+		return read_text_file(file, data, points, header);
+	}
+}
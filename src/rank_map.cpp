@@ -0,0 +1,215 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Rank maps, for real-time halftoning. Each pixel gets the rank of the point
+ * whose Voronoi cell it's in (i.e. the closest point), divided by the number of
+ * points. Dithering an image with it is then just a compare per pixel: the
+ * pixel is ink if the map is less than the darkness there, which is the same
+ * rule the stippler uses, except with every Voronoi cell filled in instead of a
+ * dot.
+ *
+ * Finding the closest point is point_grid::nearest. Distances wrap around, so
+ * the map tiles seamlessly, and ties go to the lower rank, so the result
+ * doesn't depend on the order anything is looked at in.
+ *
+ * The PNGs are written with libpng directly, since Cairo doesn't do 16 bits.
+ */
+
+#include "rank_map.hpp"
+#include "worker_pool.hpp"
+
+#include <png.h>
+
+bool parse_rank_map_format(const std::string &name, rank_map_format &format)
+{
+	if (name == "raw16") {
+		format = rank_map_format::raw16;
+	} else if (name == "raw32") {
+		format = rank_map_format::raw32;
+	} else if (name == "png16") {
+		format = rank_map_format::png16;
+	} else if (name == "png32") {
+		format = rank_map_format::png32;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+std::vector<uint32_t> make_rank_map(
+	const point_grid &grid,
+	uint32_t width,
+	uint32_t height,
+	uint32_t threads)
+{
+	std::vector<uint32_t> ranks((size_t)width * height, 0);
+
+	if (grid.size() == 0) {
+		return ranks;
+	}
+
+	worker_pool pool { threads };
+
+	pool.parallel_for(height, [&](size_t y) {
+		double v = (y + 0.5) / height;
+
+		for (uint32_t x = 0; x < width; x++) {
+			double u = (x + 0.5) / width;
+			ranks[y * width + x] = grid.nearest(u, v);
+		}
+	});
+
+	return ranks;
+}
+
+/**
+ * rank / count as fixed point with the given number of bits.
+ */
+static uint32_t normalize(uint32_t rank, uint32_t count, int bits)
+{
+	return (uint32_t)(((uint64_t)rank << bits) / count);
+}
+
+static bool save_raw(
+	const std::string &file,
+	const std::vector<uint32_t> &ranks,
+	uint32_t point_count,
+	int bits)
+{
+	std::ofstream out { file, std::ios::out | std::ios::binary };
+
+	if (!out) {
+		std::cerr << "Failed to open " << file << std::endl;
+		return false;
+	}
+
+	int bytes = bits / 8;
+	std::vector<char> buffer(ranks.size() * bytes);
+	char *dst = buffer.data();
+
+	for (auto rank : ranks) {
+		auto value = normalize(rank, point_count, bits);
+
+		for (int i = 0; i < bytes; i++) {
+			*dst++ = (char)((value >> (8 * i)) & 0xff);
+		}
+	}
+
+	out.write(buffer.data(), buffer.size());
+
+	if (!out) {
+		std::cerr << "Failed to write " << file << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+static bool save_png(
+	const std::string &file,
+	const std::vector<uint32_t> &ranks,
+	uint32_t width,
+	uint32_t height,
+	uint32_t point_count,
+	int bits)
+{
+	FILE *fp = fopen(file.c_str(), "wb");
+
+	if (!fp) {
+		std::cerr << "Failed to open " << file << std::endl;
+		return false;
+	}
+
+	auto png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	auto info = png ? png_create_info_struct(png) : nullptr;
+
+	if (!info) {
+		std::cerr << "Failed to set up libpng" << std::endl;
+		png_destroy_write_struct(&png, nullptr);
+		fclose(fp);
+		return false;
+	}
+
+	// PNGs are big-endian, so both formats are just the value's bytes from
+	// the top down. 16 bits is one gray sample, 32 bits is one RGBA pixel.
+	int bytes = bits / 8;
+	std::vector<png_byte> row((size_t)width * bytes);
+
+	if (setjmp(png_jmpbuf(png))) {
+		std::cerr << "Failed to write " << file << std::endl;
+		png_destroy_write_struct(&png, &info);
+		fclose(fp);
+		return false;
+	}
+
+	png_init_io(png, fp);
+	png_set_IHDR(png, info, width, height,
+		bits == 16 ? 16 : 8,
+		bits == 16 ? PNG_COLOR_TYPE_GRAY : PNG_COLOR_TYPE_RGBA,
+		PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT,
+		PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+
+	for (uint32_t y = 0; y < height; y++) {
+		png_byte *dst = row.data();
+
+		for (uint32_t x = 0; x < width; x++) {
+			auto value = normalize(ranks[(size_t)y * width + x], point_count, bits);
+
+			for (int i = bytes - 1; i >= 0; i--) {
+				*dst++ = (png_byte)((value >> (8 * i)) & 0xff);
+			}
+		}
+
+		png_write_row(png, row.data());
+	}
+
+	png_write_end(png, nullptr);
+	png_destroy_write_struct(&png, &info);
+
+	return fclose(fp) == 0;
+}
+
+bool save_rank_map(
+	const std::string &file,
+	const std::vector<uint32_t> &ranks,
+	uint32_t width,
+	uint32_t height,
+	uint32_t point_count,
+	rank_map_format format)
+{
+	assert(ranks.size() == (size_t)width * height);
+
+	switch (format) {
+	case rank_map_format::raw16:
+		return save_raw(file, ranks, point_count, 16);
+	case rank_map_format::raw32:
+		return save_raw(file, ranks, point_count, 32);
+	case rank_map_format::png16:
+		return save_png(file, ranks, width, height, point_count, 16);
+	case rank_map_format::png32:
+		return save_png(file, ranks, width, height, point_count, 32);
+	}
+
+	return false;
+}
@@ -0,0 +1,74 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Rank maps: an IVS baked into a tileable threshold texture. See rank_map.cpp.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+#include "point_grid.hpp"
+
+/**
+ * File formats for rank maps. The values are the normalized rank of the point,
+ * rank / N, as fixed point with 16 or 32 bits, and rows go top to bottom.
+ *
+ *   raw16  little-endian uint16 per pixel, no header
+ *   raw32  little-endian uint32 per pixel, no header
+ *   png16  16-bit grayscale PNG
+ *   png32  8-bit RGBA PNG, with the 32-bit value split over the channels,
+ *          most significant byte in red
+ */
+enum class rank_map_format {
+	raw16,
+	raw32,
+	png16,
+	png32,
+};
+
+/**
+ * Parse a rank map format name. Returns false if it's not one we know.
+ */
+bool parse_rank_map_format(const std::string &name, rank_map_format &format);
+
+/**
+ * For every pixel of a width x height image covering the unit square, the rank
+ * of the point closest to the pixel center (on the torus, so the map tiles).
+ * Row by row, top to bottom. threads is the number of threads to use, 0 for one
+ * per hardware thread.
+ */
+std::vector<uint32_t> make_rank_map(
+	const point_grid &grid,
+	uint32_t width,
+	uint32_t height,
+	uint32_t threads = 0);
+
+/**
+ * Save a rank map from make_rank_map, for a set with point_count points.
+ * Returns false, and complains on stderr, if it couldn't be saved.
+ */
+bool save_rank_map(
+	const std::string &file,
+	const std::vector<uint32_t> &ranks,
+	uint32_t width,
+	uint32_t height,
+	uint32_t point_count,
+	rank_map_format format);
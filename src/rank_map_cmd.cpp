@@ -0,0 +1,157 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The `ivs rankmap` subcommand: bake a set into a threshold texture.
+ */
+
+#include "main.hpp"
+#include "rank_map.hpp"
+
+#include <getopt.h>
+
+static void print_rank_map_help()
+{
+    std::cout << R"HELP(Incremental voronoi set rank map exporter
+
+Usage: ivs rankmap [options] <points> <output>
+
+Saves a tileable threshold texture for the set in <points> (a point file
+written by ivs, in any format, or "-" for stdin) to <output>. Each pixel holds
+the rank of the point whose Voronoi cell it's in, divided by the number of
+points, as fixed point. To halftone with it, a pixel is ink if its value is
+less than the darkness of the image there.
+
+Options:
+    -h, --help                  Print this help text
+
+    -s, --size <w>[x<h>]        Size of the texture in pixels (default 1024)
+        --format <fmt>          Format of <output>, one of:
+                                  png16  16-bit grayscale PNG (default)
+                                  png32  8-bit RGBA PNG holding a 32-bit
+                                         value, most significant byte in red
+                                  raw16  little-endian uint16 per pixel
+                                  raw32  little-endian uint32 per pixel
+    -j, --threads <n>           Number of threads (default 0 = one per core)
+)HELP";
+}
+
+/**
+ * Parses "1024" or "1024x512".
+ */
+static bool parse_size(const std::string &str, uint32_t &width, uint32_t &height)
+{
+    size_t pos;
+
+    try {
+        width = std::stoul(str, &pos);
+        height = width;
+
+        if (pos < str.size()) {
+            if (str[pos] != 'x') return false;
+
+            size_t pos2;
+            height = std::stoul(str.substr(pos + 1), &pos2);
+
+            if (pos + 1 + pos2 != str.size()) return false;
+        }
+    } catch (...) {
+        return false;
+    }
+
+    return width > 0 && height > 0;
+}
+
+int rank_map_main(int argc, char **argv)
+{
+    uint32_t width = 1024;
+    uint32_t height = 1024;
+    uint32_t threads = 0;
+    rank_map_format format = rank_map_format::png16;
+
+    static const struct option longopts[]
+    {
+        { "help",    no_argument,       0, 'h' },
+        { "size",    required_argument, 0, 's' },
+        { "format",  required_argument, 0, 'f' },
+        { "threads", required_argument, 0, 'j' },
+        { 0, 0, 0, 0 }
+    };
+
+    while (1) {
+        int optindex;
+        int c = getopt_long(argc, argv, "hs:j:", longopts, &optindex);
+
+        if (c == -1) break;
+
+        switch (c) {
+        case 'h':
+            print_rank_map_help();
+            return 0;
+
+        case 's':
+            if (!parse_size(optarg, width, height)) {
+                std::cerr << "Failed to parse size" << std::endl;
+                return 1;
+            }
+            break;
+
+        case 'f':
+            if (!parse_rank_map_format(optarg, format)) {
+                std::cerr << "Unknown rank map format: " << optarg << std::endl;
+                return 1;
+            }
+            break;
+
+        case 'j':
+            try {
+                threads = std::stoul(optarg);
+            } catch (...) {
+                std::cerr << "Failed to parse thread count" << std::endl;
+                return 1;
+            }
+            break;
+
+        case '?':
+            return 1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        std::cerr << "Expected <points> <output>, see ivs rankmap --help" << std::endl;
+        return 1;
+    }
+
+    std::vector<vec2> points;
+
+    if (!read_points(argv[optind], points)) {
+        return 1;
+    }
+
+    if (points.empty()) {
+        std::cerr << argv[optind] << " doesn't have any points" << std::endl;
+        return 1;
+    }
+
+    point_grid grid { points };
+    auto ranks = make_rank_map(grid, width, height, threads);
+
+    return save_rank_map(argv[optind + 1], ranks, width, height, points.size(), format) ? 0 : 1;
+}
@@ -0,0 +1,321 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "set_cache.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(vec2) == 2 * sizeof(double), "The mapped points are used as vec2's");
+
+static const char CACHE_SUFFIX[] = ".ivsb";
+static const char TEMP_MARKER[] = ".tmp.";
+
+/**
+ * Temporary files older than this (in seconds) are from writers that died
+ * halfway, and get cleaned up.
+ */
+static const time_t STALE_TEMP_AGE = 60 * 60;
+
+/**
+ * The cache files are binary point files, which are little-endian. Mapping
+ * them as doubles only works if we are too.
+ */
+static bool little_endian()
+{
+	uint32_t one = 1;
+	unsigned char first;
+
+	memcpy(&first, &one, 1);
+
+	return first == 1;
+}
+
+static uint32_t read_u32(const unsigned char *src)
+{
+	return (uint32_t)src[0] | (uint32_t)src[1] << 8 | (uint32_t)src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+static uint64_t file_size(uint64_t point_count)
+{
+	return POINT_FILE_HEADER_SIZE + point_count * 2 * sizeof(double);
+}
+
+static bool ends_with(const std::string &s, const char *suffix)
+{
+	size_t n = strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+cached_set::cached_set()
+	: data { nullptr }
+	, length { 0 }
+	, points { nullptr }
+	, count { 0 }
+{
+}
+
+cached_set::~cached_set()
+{
+	close();
+}
+
+void cached_set::close()
+{
+	if (data) {
+		munmap(data, length);
+	}
+
+	data = nullptr;
+	length = 0;
+	points = nullptr;
+	count = 0;
+}
+
+set_cache::set_cache(std::string dir, uint64_t max_bytes)
+	: dir { std::move(dir) }
+	, max_bytes { max_bytes }
+{
+	if (mkdir(this->dir.c_str(), 0777) != 0 && errno != EEXIST) {
+		std::cerr << "Failed to create cache directory " << this->dir << std::endl;
+	}
+}
+
+std::string set_cache::path(const std::vector<vec2> &seeds) const
+{
+	// 64-bit FNV-1a of the version and the bits of the seed points. Not a
+	// cryptographic hash, but nobody is trying to collide these.
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	auto mix = [&](const void *src, size_t size) {
+		auto bytes = (const unsigned char *)src;
+
+		for (size_t i = 0; i < size; i++) {
+			hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+		}
+	};
+
+	auto version = SET_CACHE_VERSION;
+	auto count = (uint32_t)seeds.size();
+
+	mix(&version, sizeof(version));
+	mix(&count, sizeof(count));
+
+	for (auto seed : seeds) {
+		mix(&seed.x, sizeof(seed.x));
+		mix(&seed.y, sizeof(seed.y));
+	}
+
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long)hash);
+
+	return dir + "/" + name + CACHE_SUFFIX;
+}
+
+bool set_cache::find(const std::vector<vec2> &seeds, cached_set &set) const
+{
+	set.close();
+
+	if (!little_endian()) {
+		return false;
+	}
+
+	auto file = path(seeds);
+	int fd = ::open(file.c_str(), O_RDONLY);
+
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < POINT_FILE_HEADER_SIZE) {
+		std::cerr << file << " is truncated or corrupt" << std::endl;
+		::close(fd);
+		return false;
+	}
+
+	auto mapped = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	// The mapping keeps the file alive, even if it's replaced or evicted
+	::close(fd);
+
+	if (mapped == MAP_FAILED) {
+		std::cerr << "Failed to map " << file << std::endl;
+		return false;
+	}
+
+	set.data = mapped;
+	set.length = (size_t)st.st_size;
+
+	auto header = (const unsigned char *)mapped;
+	auto count = read_u32(header + 8);
+
+	// Files only ever show up whole (see store), so this would take a
+	// broken disk or somebody else writing into the directory
+	if (memcmp(header, "IVSB", 4) != 0
+		|| read_u32(header + 4) != POINT_FILE_VERSION
+		|| read_u32(header + 20) != sizeof(double)
+		|| count == 0
+		|| set.length != file_size(count))
+	{
+		std::cerr << file << " is truncated or corrupt" << std::endl;
+		set.close();
+		return false;
+	}
+
+	set.points = (const vec2 *)(header + POINT_FILE_HEADER_SIZE);
+	set.count = count;
+
+	// Mark it as used for the eviction
+	utimensat(AT_FDCWD, file.c_str(), nullptr, 0);
+
+	return true;
+}
+
+bool set_cache::store(
+	const std::vector<vec2> &seeds,
+	uint32_t rng_seed,
+	uint32_t seed_count,
+	const std::vector<vec2> &points) const
+{
+	auto file = path(seeds);
+	auto size = file_size(points.size());
+	struct stat st;
+
+	if (points.empty() || (stat(file.c_str(), &st) == 0 && (uint64_t)st.st_size >= size)) {
+		return true;
+	}
+
+	// Unique between processes (the pid) and between threads of this one
+	// (the counter)
+	static std::atomic<uint32_t> temp_counter { 0 };
+
+	auto temp = file + TEMP_MARKER + std::to_string(getpid()) + "." + std::to_string(temp_counter++);
+
+	{
+		std::ofstream out { temp, std::ios::out | std::ios::binary };
+
+		if (out) {
+			point_file_header header { (uint32_t)points.size(), rng_seed, seed_count };
+			auto writer = make_point_writer(point_format::binary, out, header);
+
+			for (auto point : points) {
+				writer->write(point);
+			}
+
+			writer->flush();
+		}
+
+		if (!out) {
+			std::cerr << "Failed to write " << temp << std::endl;
+			unlink(temp.c_str());
+			return false;
+		}
+	}
+
+	// Somebody else might have stored a bigger one while we were writing.
+	// There's still a tiny window between this and the rename, but the worst
+	// that can happen there is that a smaller set replaces a bigger one,
+	// which is only wasted work, the points are the same.
+	if (stat(file.c_str(), &st) == 0 && (uint64_t)st.st_size >= size) {
+		unlink(temp.c_str());
+		return true;
+	}
+
+	if (rename(temp.c_str(), file.c_str()) != 0) {
+		std::cerr << "Failed to move " << temp << " to " << file << std::endl;
+		unlink(temp.c_str());
+		return false;
+	}
+
+	evict(file);
+
+	return true;
+}
+
+void set_cache::evict(const std::string &keep) const
+{
+	struct entry {
+		std::string path;
+		uint64_t size;
+		struct timespec used;
+	};
+
+	std::vector<entry> entries;
+	uint64_t total = 0;
+
+	DIR *d = opendir(dir.c_str());
+
+	if (!d) {
+		return;
+	}
+
+	auto now = time(nullptr);
+
+	while (auto e = readdir(d)) {
+		std::string name = e->d_name;
+		std::string file = dir + "/" + name;
+		struct stat st;
+
+		bool temp = name.find(TEMP_MARKER) != std::string::npos;
+
+		if ((!temp && !ends_with(name, CACHE_SUFFIX)) || stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+			continue;
+		}
+
+		if (temp) {
+			if (now - st.st_mtime > STALE_TEMP_AGE) {
+				unlink(file.c_str());
+			}
+
+			continue;
+		}
+
+		total += (uint64_t)st.st_size;
+		entries.push_back(entry { file, (uint64_t)st.st_size, st.st_mtim });
+	}
+
+	closedir(d);
+
+	std::sort(entries.begin(), entries.end(), [](const entry &a, const entry &b) {
+		if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+		return a.used.tv_nsec < b.used.tv_nsec;
+	});
+
+	// Another process might be doing the same thing right now, so files
+	// that are already gone are fine
+	for (size_t i = 0; i < entries.size() && total > max_bytes; i++) {
+		if (entries[i].path == keep) continue;
+
+		if (unlink(entries[i].path.c_str()) == 0 || errno == ENOENT) {
+			total -= entries[i].size;
+		}
+	}
+}
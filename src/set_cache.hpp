@@ -0,0 +1,132 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * An on-disk cache of generated sets.
+ *
+ * Lots of the time the generator gets asked for the same set over and over,
+ * just with a different number of points. Since every prefix of an IVS is an
+ * IVS, one big set can answer all of those: asking for N points is just
+ * reading the first N points of any cached set that has at least that many.
+ * And asking for more than what's cached is a --resume from the biggest one,
+ * which gives exactly the same points as generating from scratch.
+ *
+ * The sets live in a directory, one file per set, named after a hash of
+ * everything that decides what the points are (the seed points and
+ * SET_CACHE_VERSION). Engines, queues and thread counts don't go in there,
+ * since they all give the same points. The files are regular binary point files
+ * (with doubles, so nothing is lost), so you can also use them directly with
+ * --resume or the stippler.
+ *
+ * Reading a set maps the file, so serving a prefix doesn't copy anything. New
+ * sets are written to a temporary file that is then renamed over the old one,
+ * which means other processes see either the old set or the new one and never
+ * half of one. Anyone that has the old one mapped keeps it until they unmap it.
+ * When the directory gets bigger than its limit, the sets that were used the
+ * longest time ago get deleted (using is touching the file, so it's the
+ * modification time that counts).
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+/**
+ * Goes into the hash of the sets. Bump this when a change to the generator
+ * changes which points it produces, and the old sets turn into misses.
+ */
+constexpr uint32_t SET_CACHE_VERSION = 1;
+
+/**
+ * A set from the cache, mapped into memory.
+ */
+class cached_set
+{
+public:
+	cached_set();
+	~cached_set();
+
+	cached_set(const cached_set&) = delete;
+	cached_set &operator=(const cached_set&) = delete;
+
+	/**
+	 * Unmap the file. Pointers into the set are dead after this.
+	 */
+	void close();
+
+	const vec2 *begin() const { return points; }
+	const vec2 *end() const { return points + count; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	const vec2 &operator[](size_t i) const { return points[i]; }
+
+private:
+	friend class set_cache;
+
+	void *data;
+	size_t length;
+
+	const vec2 *points;
+	size_t count;
+};
+
+class set_cache
+{
+public:
+	/**
+	 * A cache in directory dir (which is created if it isn't there), that
+	 * is kept under max_bytes.
+	 */
+	set_cache(std::string dir, uint64_t max_bytes);
+
+	/**
+	 * The name of the cache file for a set generated from these seeds.
+	 */
+	std::string path(const std::vector<vec2> &seeds) const;
+
+	/**
+	 * Map the cached set for these seeds. Returns false if there isn't one
+	 * (which isn't an error, so that's quiet, unlike a file that's broken).
+	 */
+	bool find(const std::vector<vec2> &seeds, cached_set &set) const;
+
+	/**
+	 * Put a set generated from these seeds into the cache, unless there's
+	 * already one that's at least as big. rng_seed and seed_count are just
+	 * for the header of the file. Returns false (after complaining to stderr)
+	 * if it couldn't be written.
+	 */
+	bool store(
+		const std::vector<vec2> &seeds,
+		uint32_t rng_seed,
+		uint32_t seed_count,
+		const std::vector<vec2> &points) const;
+
+private:
+	std::string dir;
+	uint64_t max_bytes;
+
+	/**
+	 * Delete the least recently used sets until the directory fits in
+	 * max_bytes, but never the file keep.
+	 */
+	void evict(const std::string &keep) const;
+};
@@ -0,0 +1,112 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Drawing the sites (the dots) straight into the pixels of an image, instead of
+ * going through Cairo. See site_raster.cpp.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+#include "worker_pool.hpp"
+
+#include <cairo.h>
+
+/**
+ * An anti-aliased disc of one particular radius, which can be stamped into an
+ * 8-bit coverage buffer. For small radii (which is every radius anyone uses)
+ * the coverage is precomputed for a grid of positions within a pixel, so
+ * stamping is just copying.
+ */
+class disc_stamps
+{
+public:
+	explicit disc_stamps(float radius);
+
+	/**
+	 * How far outside the center pixel the disc can reach, in pixels.
+	 */
+	int32_t extent() const { return ext; }
+
+	/**
+	 * Stamp a disc centered at (cx, cy) (in pixels, y going down) into a
+	 * coverage buffer that holds the pixels [x0, x0 + width) x [y0, y0 +
+	 * height), row by row. Overlapping discs take the max.
+	 */
+	void stamp(
+		uint8_t *coverage,
+		int32_t x0,
+		int32_t y0,
+		int32_t width,
+		int32_t height,
+		double cx,
+		double cy) const;
+
+private:
+	float radius;
+	int32_t ext;
+
+	// (2 * ext + 1)^2 coverage values for every one of PHASES^2 positions
+	// within a pixel. Empty for discs too big to be worth it.
+	std::vector<uint8_t> stamps;
+};
+
+/**
+ * Draws sites as black dots of radius draw.point_size over a Cairo image
+ * surface. Big batches are split into bands of rows, drawn in parallel.
+ */
+class site_raster
+{
+public:
+	explicit site_raster(const draw_options &draw);
+
+	/**
+	 * Draw dots for the sites (in the unit square, y going up, the same way the
+	 * drawing contexts in drawer.cpp are set up) onto the surface, which has to
+	 * be a draw.img_size square ARGB32 or RGB24 image. Only the pixels
+	 * [x0, x1) x [y0, y1) are touched.
+	 */
+	void draw(
+		cairo_surface_t *surface,
+		const std::vector<vec2> &sites,
+		int32_t x0,
+		int32_t y0,
+		int32_t x1,
+		int32_t y1);
+
+	/**
+	 * Same, without the clipping.
+	 */
+	void draw(cairo_surface_t *surface, const std::vector<vec2> &sites);
+
+private:
+	uint32_t size;
+	disc_stamps disc;
+
+	// Only started when there's a batch big enough to need it
+	uint32_t threads;
+	std::unique_ptr<worker_pool> pool;
+
+	// Scratch space for sorting the sites into bands
+	std::vector<vec2> pixels;
+	std::vector<uint32_t> band_starts;
+	std::vector<uint32_t> band_sites;
+};
@@ -0,0 +1,108 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * A lock-free single producer, single consumer ring buffer. One thread pushes,
+ * one (other) thread pops, and neither of them ever waits for the other: push
+ * just fails if the ring is full, and pop fails if it's empty.
+ *
+ * The head and tail live on separate cache lines, and each side keeps a cached
+ * copy of the other side's index, so in the common case a push or pop doesn't
+ * touch anything the other thread is writing to.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+template <typename T>
+class spsc_ring
+{
+public:
+	/**
+	 * Capacity is rounded up to a power of two.
+	 */
+	explicit spsc_ring(size_t capacity)
+		: head { 0 }
+		, tail_cache { 0 }
+		, tail { 0 }
+		, head_cache { 0 }
+	{
+		size_t size = 1;
+		while (size < capacity) size *= 2;
+
+		slots.resize(size);
+		mask = size - 1;
+	}
+
+	spsc_ring(const spsc_ring&) = delete;
+	spsc_ring &operator=(const spsc_ring&) = delete;
+
+	/**
+	 * Producer side. Returns false if the ring is full.
+	 */
+	bool push(const T &value)
+	{
+		auto t = tail.load(std::memory_order_relaxed);
+
+		if (t - head_cache == slots.size()) {
+			head_cache = head.load(std::memory_order_acquire);
+
+			if (t - head_cache == slots.size()) return false;
+		}
+
+		slots[t & mask] = value;
+		tail.store(t + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	/**
+	 * Consumer side. Returns false if the ring is empty.
+	 */
+	bool pop(T &value)
+	{
+		auto h = head.load(std::memory_order_relaxed);
+
+		if (h == tail_cache) {
+			tail_cache = tail.load(std::memory_order_acquire);
+
+			if (h == tail_cache) return false;
+		}
+
+		value = slots[h & mask];
+		head.store(h + 1, std::memory_order_release);
+
+		return true;
+	}
+
+private:
+	std::vector<T> slots;
+	size_t mask;
+
+	// Written by the consumer
+	alignas(64) std::atomic<size_t> head;
+	size_t tail_cache;
+
+	// Written by the producer
+	alignas(64) std::atomic<size_t> tail;
+	size_t head_cache;
+};
@@ -0,0 +1,98 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Reporting for ivs_stats: peak memory usage and the JSON the benchmark and
+ * --stats write.
+ */
+
+#include "ivs.hpp"
+
+#include <sys/resource.h>
+
+void write_stats_json(std::ostream &out, const ivs_stats &s, const std::string &indent)
+{
+	// Per-point averages, for the part where there is a queue
+	auto per_point = [&](double value) {
+		return s.queued_points > 0 ? value / (double)s.queued_points : 0.0;
+	};
+
+	auto precision = out.precision(9);
+
+	out << indent << "\"peak_rss\": " << s.peak_rss << ",\n"
+		<< indent << "\"one_sheet_switch\": " << s.one_sheet_switch << ",\n"
+		<< indent << "\"queued_points\": " << s.queued_points << ",\n"
+		<< indent << "\"queue_high_water\": " << s.queue_high_water << ",\n"
+		<< indent << "\"queue_mean\": " << per_point((double)s.queue_size_sum) << ",\n"
+		<< indent << "\"pops\": " << s.pops << ",\n"
+		<< indent << "\"stale_pops\": " << s.stale_pops << ",\n"
+		<< indent << "\"stale_pops_per_point\": " << per_point((double)s.stale_pops) << ",\n"
+		<< indent << "\"removed_faces\": " << s.removed_faces << ",\n"
+		<< indent << "\"created_faces\": " << s.created_faces << ",\n"
+		<< indent << "\"created_faces_per_point\": " << per_point((double)s.created_faces) << ",\n"
+		<< indent << "\"speculation_misses\": " << s.speculation_misses << ",\n"
+		<< indent << "\"tiled_rounds\": " << s.tiled_rounds << ",\n"
+		<< indent << "\"tiled_overshoot\": " << s.tiled_overshoot << ",\n"
+		<< indent << "\"order_inversions\": " << s.order_inversions << ",\n"
+		<< indent << "\"seconds\": {\n"
+		<< indent << "  \"total\": " << s.total << ",\n"
+		<< indent << "  \"nine_sheet_scan\": " << s.nine_sheet_scan << ",\n"
+		<< indent << "  \"bulk_fill\": " << s.bulk_fill << ",\n"
+		<< indent << "  \"insert\": " << s.insert << ",\n"
+		<< indent << "  \"enqueue\": " << s.enqueue << ",\n"
+		<< indent << "  \"pop\": " << s.pop << ",\n"
+		<< indent << "  \"remove\": " << s.remove << ",\n"
+		<< indent << "  \"output\": " << s.output << ",\n"
+		<< indent << "  \"tiled_refine\": " << s.tiled_refine << ",\n"
+		<< indent << "  \"tiled_exchange\": " << s.tiled_exchange << "\n"
+		<< indent << "}\n";
+
+	out.precision(precision);
+}
+
+void reset_peak_rss()
+{
+	std::ofstream clear_refs { "/proc/self/clear_refs" };
+
+	if (clear_refs) {
+		clear_refs << "5";
+	}
+}
+
+uint64_t peak_rss()
+{
+	std::ifstream status { "/proc/self/status" };
+	std::string line;
+
+	while (std::getline(status, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) {
+			return std::stoull(line.substr(6)) * 1024;
+		}
+	}
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+	return usage.ru_maxrss;
+#else
+	return usage.ru_maxrss * 1024;
+#endif
+}
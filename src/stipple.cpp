@@ -0,0 +1,280 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The stippler. This is the whole point of an IVS: since every prefix of the
+ * set is itself evenly spread out, you can get any density you like just by
+ * keeping the first so-many points. So to stipple an image, each point looks at
+ * how dark the image is where it is, and it's kept if its rank (its index in
+ * the set) is below darkness * N. Completely black areas get every point,
+ * completely white areas get none, and everything in between gets an evenly
+ * spread out subset.
+ *
+ * The set is tiled across the image (it's periodic, so that works out fine),
+ * and the points live in a point_grid, so for each part of the image we only
+ * look at the points that can actually end up there.
+ *
+ * Rendering splits the image into bands of rows, which are rendered in
+ * parallel. Each band has its own coverage buffer, and dots are splatted into
+ * it with a little anti-aliased disc kernel. The kernel has no branches or
+ * square roots in the inner loop (the edge falloff is done on the squared
+ * distance, which is close enough at the edge of a disc), so the compiler
+ * vectorizes it. A dot that straddles two bands gets drawn in both, clipped to
+ * each.
+ */
+
+#include "stipple.hpp"
+#include "worker_pool.hpp"
+
+#include <cairo.h>
+
+float gray_image::sample(double x, double y) const
+{
+	x = std::clamp(x - 0.5, 0.0, (double)width  - 1);
+	y = std::clamp(y - 0.5, 0.0, (double)height - 1);
+
+	auto x0 = (uint32_t)x;
+	auto y0 = (uint32_t)y;
+	auto x1 = std::min(x0 + 1, width  - 1);
+	auto y1 = std::min(y0 + 1, height - 1);
+
+	auto fx = (float)(x - x0);
+	auto fy = (float)(y - y0);
+
+	auto top    = at(x0, y0) + fx * (at(x1, y0) - at(x0, y0));
+	auto bottom = at(x0, y1) + fx * (at(x1, y1) - at(x0, y1));
+
+	return top + fy * (bottom - top);
+}
+
+bool load_gray_png(const std::string &file, gray_image &image)
+{
+	auto surface = cairo_image_surface_create_from_png(file.c_str());
+
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		std::cerr << "Failed to load " << file << ": "
+			<< cairo_status_to_string(cairo_surface_status(surface)) << std::endl;
+		cairo_surface_destroy(surface);
+		return false;
+	}
+
+	auto format = cairo_image_surface_get_format(surface);
+
+	if (format != CAIRO_FORMAT_ARGB32 && format != CAIRO_FORMAT_RGB24 && format != CAIRO_FORMAT_A8) {
+		std::cerr << "Unsupported pixel format in " << file << std::endl;
+		cairo_surface_destroy(surface);
+		return false;
+	}
+
+	cairo_surface_flush(surface);
+
+	image = gray_image {
+		(uint32_t)cairo_image_surface_get_width(surface),
+		(uint32_t)cairo_image_surface_get_height(surface) };
+
+	auto data = cairo_image_surface_get_data(surface);
+	auto stride = cairo_image_surface_get_stride(surface);
+
+	for (uint32_t y = 0; y < image.height; y++) {
+		auto row = data + (size_t)y * stride;
+
+		for (uint32_t x = 0; x < image.width; x++) {
+			float value;
+
+			if (format == CAIRO_FORMAT_A8) {
+				// Just an alpha mask, so treat it as black on white
+				value = 1.0f - row[x] / 255.0f;
+			} else {
+				uint32_t pixel;
+				memcpy(&pixel, row + 4 * x, 4);
+
+				// Cairo's colors are premultiplied, so adding the missing
+				// alpha as white puts the image on a white background.
+				float a = format == CAIRO_FORMAT_ARGB32 ? ((pixel >> 24) & 0xff) / 255.0f : 1.0f;
+				float r = ((pixel >> 16) & 0xff) / 255.0f;
+				float g = ((pixel >>  8) & 0xff) / 255.0f;
+				float b = ((pixel >>  0) & 0xff) / 255.0f;
+
+				value = 0.2126f * r + 0.7152f * g + 0.0722f * b + (1.0f - a);
+			}
+
+			image.pixels[(size_t)y * image.width + x] = std::clamp(value, 0.0f, 1.0f);
+		}
+	}
+
+	cairo_surface_destroy(surface);
+
+	return true;
+}
+
+bool save_gray_png(const std::string &file, const gray_image &image)
+{
+	auto surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, image.width, image.height);
+	auto data = cairo_image_surface_get_data(surface);
+	auto stride = cairo_image_surface_get_stride(surface);
+
+	cairo_surface_flush(surface);
+
+	for (uint32_t y = 0; y < image.height; y++) {
+		auto row = data + (size_t)y * stride;
+
+		for (uint32_t x = 0; x < image.width; x++) {
+			auto v = (uint32_t)std::lround(std::clamp(image.at(x, y), 0.0f, 1.0f) * 255.0f);
+			uint32_t pixel = 0xff000000 | v << 16 | v << 8 | v;
+
+			memcpy(row + 4 * x, &pixel, 4);
+		}
+	}
+
+	cairo_surface_mark_dirty(surface);
+
+	auto status = cairo_surface_write_to_png(surface, file.c_str());
+	cairo_surface_destroy(surface);
+
+	if (status != CAIRO_STATUS_SUCCESS) {
+		std::cerr << "Failed to save " << file << ": " << cairo_status_to_string(status) << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Rows per band when rendering. 
+ */
+static const uint32_t BAND_HEIGHT = 16;
+
+/**
+ * Draw an anti-aliased disc into a band's coverage buffer (which holds rows
+ * [y0, y1)). Coverage goes from 1 inside radius - 0.5 to 0 at radius + 0.5,
+ * and overlapping dots just take the max.
+ */
+static void splat(
+	float *coverage,
+	uint32_t width,
+	uint32_t y0,
+	uint32_t y1,
+	float cx,
+	float cy,
+	float radius)
+{
+	float outer = radius + 0.5f;
+	float outer2 = outer * outer;
+	float falloff = 1.0f / (2.0f * radius);
+
+	auto ya = std::max<int64_t>(y0, (int64_t)std::floor(cy - outer));
+	auto yb = std::min<int64_t>((int64_t)y1 - 1, (int64_t)std::ceil(cy + outer));
+	auto xa = std::max<int64_t>(0, (int64_t)std::floor(cx - outer));
+	auto xb = std::min<int64_t>((int64_t)width - 1, (int64_t)std::ceil(cx + outer));
+
+	for (auto y = ya; y <= yb; y++) {
+		float dy = y + 0.5f - cy;
+		float dy2 = dy * dy;
+		float *row = coverage + (size_t)(y - y0) * width;
+
+		for (auto x = xa; x <= xb; x++) {
+			float dx = x + 0.5f - cx;
+			float a = (outer2 - (dx * dx + dy2)) * falloff;
+
+			a = std::min(std::max(a, 0.0f), 1.0f);
+			row[x] = std::max(row[x], a);
+		}
+	}
+}
+
+gray_image stipple(const point_grid &grid, const gray_image &image, const stipple_options &options)
+{
+	auto width  = (uint32_t)std::lround(image.width  * options.scale);
+	auto height = (uint32_t)std::lround(image.height * options.scale);
+
+	gray_image out { width, height };
+
+	if (width == 0 || height == 0 || grid.size() == 0) {
+		return out;
+	}
+
+	double tile = options.tile_size > 0 ? options.tile_size : std::max(width, height);
+	float radius = std::max(options.dot_radius, 0.5f);
+	double reach = radius + 0.5;
+	double count = (double)grid.size();
+
+	worker_pool pool { options.threads };
+
+	uint32_t bands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+
+	pool.parallel_for(bands, [&](size_t band) {
+		auto y0 = (uint32_t)band * BAND_HEIGHT;
+		auto y1 = std::min(y0 + BAND_HEIGHT, height);
+
+		std::vector<float> coverage((size_t)width * (y1 - y0), 0.0f);
+
+		// Any dot with its center in here can touch the band
+		double cx0 = -reach;
+		double cx1 = width + reach;
+		double cy0 = y0 - reach;
+		double cy1 = y1 + reach;
+
+		for (auto ty = (int64_t)std::floor(cy0 / tile); ty <= (int64_t)std::floor(cy1 / tile); ty++) {
+			// The part of this row of copies of the set that's in the band
+			double v0 = std::max(cy0 / tile - ty, 0.0);
+			double v1 = std::min(cy1 / tile - ty, 1.0);
+
+			if (v0 >= v1) continue;
+
+			auto gy0 = grid.cell(v0);
+			auto gy1 = grid.cell(v1);
+
+			for (auto tx = (int64_t)std::floor(cx0 / tile); tx <= (int64_t)std::floor(cx1 / tile); tx++) {
+				double u0 = std::max(cx0 / tile - tx, 0.0);
+				double u1 = std::min(cx1 / tile - tx, 1.0);
+
+				if (u0 >= u1) continue;
+
+				auto gx0 = grid.cell(u0);
+				auto gx1 = grid.cell(u1);
+
+				for (auto gy = gy0; gy <= gy1; gy++) {
+					auto kb = grid.begin(gx0, gy);
+					auto ke = grid.end(gx1, gy);
+
+					for (auto k = kb; k < ke; k++) {
+						double px = (tx + grid.x(k)) * tile;
+						double py = (ty + grid.y(k)) * tile;
+
+						if (px < cx0 || px >= cx1 || py < cy0 || py >= cy1) continue;
+
+						float value = image.sample(px / options.scale, py / options.scale);
+						float darkness = options.invert ? value : 1.0f - value;
+
+						if (grid.rank(k) >= darkness * count) continue;
+
+						splat(coverage.data(), width, y0, y1, (float)px, (float)py, radius);
+					}
+				}
+			}
+		}
+
+		for (size_t j = 0; j < coverage.size(); j++) {
+			out.pixels[(size_t)y0 * width + j] = 1.0f - coverage[j];
+		}
+	});
+
+	return out;
+}
@@ -0,0 +1,111 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * Stippling: turning a grayscale image into dots using an IVS. See stipple.cpp.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+#include "point_grid.hpp"
+
+/**
+ * A grayscale image, stored as floats where 0 is black and 1 is white. 
+ */
+struct gray_image {
+	uint32_t width;
+	uint32_t height;
+
+	// Row by row, top to bottom
+	std::vector<float> pixels;
+
+	gray_image()
+		: width  { 0 }
+		, height { 0 }
+	{
+	}
+
+	gray_image(uint32_t width, uint32_t height, float fill = 1.0f)
+		: width  { width }
+		, height { height }
+		, pixels ((size_t)width * height, fill)
+	{
+	}
+
+	float at(uint32_t x, uint32_t y) const { return pixels[(size_t)y * width + x]; }
+
+	/**
+	 * Bilinearly interpolated value at (x, y), in pixels (so the center of the
+	 * top left pixel is (0.5, 0.5)). Clamps at the edges.
+	 */
+	float sample(double x, double y) const;
+};
+
+/**
+ * Load a PNG into a gray_image (colors are turned into luminance, and anything
+ * transparent is put on a white background). Returns false, and complains on
+ * stderr, if it couldn't be loaded.
+ */
+bool load_gray_png(const std::string &file, gray_image &image);
+
+/**
+ * Save a gray_image as a PNG. Returns false, and complains on stderr, if it
+ * couldn't be saved.
+ */
+bool save_gray_png(const std::string &file, const gray_image &image);
+
+/**
+ * Options for stipple. 
+ */
+struct stipple_options {
+	// Radius of the dots, in output pixels
+	float dot_radius;
+
+	// Size of one copy of the set in output pixels. The set is tiled across
+	// the image. Zero means the larger side of the output, i.e. one copy
+	// covers the whole thing.
+	float tile_size;
+
+	// Size of the output relative to the input image
+	float scale;
+
+	// Put dots in the light parts instead of the dark parts. An int so it
+	// plays nice with getopt.
+	int invert;
+
+	// Threads to render with, 0 means one per hardware thread
+	uint32_t threads;
+
+	stipple_options()
+		: dot_radius { 1.0f }
+		, tile_size  { 0.0f }
+		, scale      { 1.0f }
+		, invert     { false }
+		, threads    { 0 }
+	{
+	}
+};
+
+/**
+ * Stipple image with the points in grid (which should be an IVS, in the order
+ * it was generated): black dots on a white background.
+ */
+gray_image stipple(const point_grid &grid, const gray_image &image, const stipple_options &options);
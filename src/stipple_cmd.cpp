@@ -0,0 +1,129 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * The `ivs stipple` subcommand: stipple an image with a set generated earlier.
+ */
+
+#include "main.hpp"
+#include "stipple.hpp"
+
+#include <getopt.h>
+
+static void print_stipple_help()
+{
+    std::cout << R"HELP(Incremental voronoi set stippler
+
+Usage: ivs stipple [options] <points> <image> <output>
+
+Stipples <image> (a PNG) with the set in <points> (a point file written by ivs,
+in any format, or "-" for stdin) and saves the result as a PNG to <output>.
+A point is drawn if its index in the set is less than the darkness of the image
+where it is times the number of points.
+
+Options:
+    -h, --help                  Print this help text
+
+    -r, --dot-radius <n>        Radius of the dots in pixels (default 1)
+    -t, --tile <n>              Size of one copy of the set in pixels, the set
+                                is tiled to cover the image (default is the
+                                larger side of the output)
+    -s, --scale <n>             Size of the output relative to the image
+                                (default 1)
+        --invert                Put dots in the light areas instead
+    -j, --threads <n>           Number of threads (default 0 = one per core)
+)HELP";
+}
+
+int stipple_main(int argc, char **argv)
+{
+    stipple_options sopts;
+    int help = false;
+
+    static const struct option longopts[]
+    {
+        { "help",       no_argument,       &help, 1 },
+        { "dot-radius", required_argument, 0, 'r' },
+        { "tile",       required_argument, 0, 't' },
+        { "scale",      required_argument, 0, 's' },
+        { "invert",     no_argument,       &(sopts.invert), 1 },
+        { "threads",    required_argument, 0, 'j' },
+        { 0, 0, 0, 0 }
+    };
+
+    while (1) {
+        int optindex;
+        int c = getopt_long(argc, argv, "hr:t:s:j:", longopts, &optindex);
+
+        if (c == -1) break;
+
+        try {
+            switch (c) {
+            case 'h':
+                help = true;
+                break;
+            case 'r':
+                sopts.dot_radius = std::stof(optarg);
+                break;
+            case 't':
+                sopts.tile_size = std::stof(optarg);
+                break;
+            case 's':
+                sopts.scale = std::stof(optarg);
+                break;
+            case 'j':
+                sopts.threads = std::stoul(optarg);
+                break;
+            case '?':
+                return 1;
+            }
+        } catch (...) {
+            std::cerr << "Failed to parse " << argv[optind - 1] << std::endl;
+            return 1;
+        }
+    }
+
+    if (help) {
+        print_stipple_help();
+        return 0;
+    }
+
+    if (argc - optind != 3) {
+        std::cerr << "Expected <points> <image> <output>, see ivs stipple --help" << std::endl;
+        return 1;
+    }
+
+    if (sopts.scale <= 0 || sopts.dot_radius <= 0) {
+        std::cerr << "Scale and dot radius should be > 0" << std::endl;
+        return 1;
+    }
+
+    std::vector<vec2> points;
+    gray_image image;
+
+    if (!read_points(argv[optind], points) || !load_gray_png(argv[optind + 1], image)) {
+        return 1;
+    }
+
+    point_grid grid { points };
+    auto result = stipple(grid, image, sopts);
+
+    return save_gray_png(argv[optind + 2], result) ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "tile_refiner.hpp"
+
+tile_refiner::tile_refiner(uint32_t tx, uint32_t ty, uint32_t side, double halo)
+	: pops { 0 }
+	, removed_faces { 0 }
+	, created_faces { 0 }
+	, inversions { 0 }
+	, tx { tx }
+	, ty { ty }
+	, side { side }
+	, x0 { (double)tx / side }
+	, x1 { (double)(tx + 1) / side }
+	, y0 { (double)ty / side }
+	, y1 { (double)(ty + 1) / side }
+	, halo { halo }
+	, last_stamp { 0 }
+	, hint { }
+{
+	assert(halo < 0.5 / side);
+}
+
+bool tile_refiner::local(vec2 p, vec2 &moved) const
+{
+	// The region is less than one wide, so there's at most one copy of the
+	// point in it
+	auto shift = [&](double v, double lo, double hi, double &out) {
+		for (double s : { 0.0, -1.0, 1.0 }) {
+			if (v + s >= lo - halo && v + s < hi + halo) {
+				out = v + s;
+				return true;
+			}
+		}
+
+		return false;
+	};
+
+	return shift(p.x, x0, x1, moved.x) && shift(p.y, y0, y1, moved.y);
+}
+
+bool tile_refiner::owns(vec2 p) const
+{
+	// The same rounding for every tile, so that every point on the torus is
+	// in exactly one square
+	auto tile_of = [&](double v) {
+		return std::min(side - 1, (uint32_t)(v * side));
+	};
+
+	return p.x >= 0 && p.x < 1 && p.y >= 0 && p.y < 1
+		&& tile_of(p.x) == tx && tile_of(p.y) == ty;
+}
+
+void tile_refiner::assign(const std::vector<tiled_point> &points)
+{
+	std::vector<std::pair<TDT::Point, double>> inside;
+
+	for (const auto &p : points) {
+		vec2 moved;
+
+		if (local(p.point, moved)) {
+			inside.emplace_back(TDT::Point { moved.x, moved.y }, p.r2);
+		}
+	}
+
+	trig.clear();
+	pq.clear();
+	hint = TDT::Face_handle();
+
+	// Spatially sorted and way faster than one at a time, like resume
+	trig.insert(inside.begin(), inside.end());
+
+	created.clear();
+
+	for (auto it = trig.finite_faces_begin(); it != trig.finite_faces_end(); it++) {
+		created.push_back(it);
+	}
+
+	enqueue_created();
+}
+
+void tile_refiner::refine(double threshold2, std::vector<tiled_point> &out)
+{
+	while (!pq.empty() && pq.top().r2 > threshold2) {
+		auto top = pq.pop();
+
+		pops++;
+
+		for (int k = 0; k < 3; k++) {
+			if (top.face->vertex(k)->info() < top.r2) {
+				inversions++;
+				break;
+			}
+		}
+
+		insert(top.center, top.r2, top.face);
+		out.push_back(tiled_point { top.center, top.r2 });
+	}
+}
+
+void tile_refiner::insert_halo(const std::vector<tiled_point> &points)
+{
+	for (const auto &p : points) {
+		vec2 moved;
+
+		if (local(p.point, moved)) {
+			insert(moved, p.r2, hint);
+		}
+	}
+}
+
+void tile_refiner::insert(vec2 p, double r2, TDT::Face_handle start)
+{
+	TDT::Point point { p.x, p.y };
+
+	conflicts.clear();
+	trig.get_conflicts(point, std::back_inserter(conflicts), start);
+
+	for (auto face : conflicts) {
+		pq.remove(face);
+	}
+
+	removed_faces += conflicts.size();
+
+	auto vertex = trig.insert(point, start);
+	vertex->info() = r2;
+
+	// Same as in the PDT, every new face has the new vertex as a corner
+	created.clear();
+
+	auto fc = trig.incident_faces(vertex);
+	auto done = fc;
+
+	do {
+		created.push_back(fc);
+	} while (++fc != done);
+
+	// Counted before enqueue_created drops the infinite ones, so that it's
+	// every face the insertion made, like created_faces in the PDT engines
+	created_faces += created.size();
+
+	enqueue_created();
+
+	hint = vertex->face();
+}
+
+void tile_refiner::enqueue_created()
+{
+	circles.clear();
+
+	size_t n = 0;
+
+	for (auto face : created) {
+		if (trig.is_infinite(face)) continue;
+
+		auto corner = [&](int k) {
+			auto p = face->vertex(k)->point();
+			return vec2 { p.x(), p.y() };
+		};
+
+		circles.push(corner(0), corner(1), corner(2));
+		created[n++] = face;
+	}
+
+	created.resize(n);
+	circles.compute();
+
+	for (size_t k = 0; k < created.size(); k++) {
+		if (!owns(circles.center(k))) continue;
+
+		auto stamp = ++last_stamp;
+
+		created[k]->info().stamp = stamp;
+		pq.push(entry { circles.r2(k), circles.center(k), created[k], stamp });
+	}
+}
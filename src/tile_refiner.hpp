@@ -0,0 +1,160 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * One tile of the tiled engine (see run_tiled in ivs.cpp).
+ *
+ * A tile is a square of the torus plus a halo around it, with a triangulation
+ * of all the points in that region and a priority queue of the faces whose
+ * circumcenters are inside the square. The halo is wide enough that those
+ * faces are the same as they would be in the triangulation of the whole set,
+ * so the tile can go on generating points inside its square on its own, as
+ * long as nobody else is adding points anywhere near it. The points its
+ * neighbors add in their squares come in through insert_halo.
+ *
+ * The region is just a square, not a torus, so this is a regular CGAL Delaunay
+ * triangulation with everything shifted so the square is where it is on the
+ * torus (a point in the halo across the edge of the torus is moved by one).
+ * Faces out at the edge of the region are nonsense, but they're nowhere near
+ * the square, so they never get queued.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+#include "face_queue.hpp"
+#include "circumcircle.hpp"
+
+#include <CGAL/Delaunay_triangulation_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+
+/**
+ * Every vertex of a tile keeps the squared radius of the circle it was the
+ * center of (infinity for the points of the exact prefix), which is where it
+ * ends up in the output. Faces have the same info as in the PDT.
+ */
+typedef CGAL::Triangulation_vertex_base_with_info_2<double, K>  Tile_vb;
+typedef CGAL::Triangulation_face_base_with_info_2<face_info, K> Tile_fb;
+typedef CGAL::Triangulation_data_structure_2<Tile_vb, Tile_fb>  Tile_tds;
+
+typedef CGAL::Delaunay_triangulation_2<K, Tile_tds> TDT;
+
+/**
+ * A point generated by a tile, with the squared radius of its circle. The
+ * output is sorted on the radius, largest first, with ties broken on the point
+ * like in the queue.
+ */
+struct tiled_point {
+	vec2 point;
+	double r2;
+};
+
+inline bool operator<(const tiled_point &p0, const tiled_point &p1)
+{
+	if (p0.r2 != p1.r2) return p0.r2 < p1.r2;
+	if (p0.point.x != p1.point.x) return p0.point.x < p1.point.x;
+	return p0.point.y < p1.point.y;
+}
+
+class tile_refiner
+{
+public:
+	/**
+	 * Tile (tx, ty) in a grid of side x side tiles, with a halo of the given
+	 * width (which has to be less than half a tile).
+	 */
+	tile_refiner(uint32_t tx, uint32_t ty, uint32_t side, double halo);
+
+	tile_refiner(const tile_refiner&) = delete;
+	tile_refiner &operator=(const tile_refiner&) = delete;
+
+	/**
+	 * Fill an empty tile with the points (in [0,1)) that are in its region,
+	 * all in one go, and queue up its faces.
+	 */
+	void assign(const std::vector<tiled_point> &points);
+
+	/**
+	 * Generate points in the square until there aren't any circles left with
+	 * a squared radius bigger than threshold2, biggest first. The points are
+	 * added to out, in [0,1).
+	 */
+	void refine(double threshold2, std::vector<tiled_point> &out);
+
+	/**
+	 * Add points generated by another tile. The ones outside the region are
+	 * skipped, so just hand it everything the neighbor made.
+	 */
+	void insert_halo(const std::vector<tiled_point> &points);
+
+	// Counters for ivs_stats, only ever added to
+	uint64_t pops;
+	uint64_t removed_faces;
+	uint64_t created_faces;
+	uint64_t inversions;
+
+private:
+	using entry = face_entry<TDT::Face_handle>;
+
+	struct faces {
+		static uint32_t &slot(TDT::Face_handle face) { return face->info().slot; }
+		static uint32_t stamp(TDT::Face_handle face) { return face->info().stamp; }
+	};
+
+	uint32_t tx, ty, side;
+
+	// The square is [x0, x1) x [y0, y1), the region is that plus the halo
+	double x0, x1, y0, y1;
+	double halo;
+
+	TDT trig;
+	face_heap<entry, faces> pq;
+	uint32_t last_stamp;
+
+	// Scratch space
+	std::vector<TDT::Face_handle> conflicts;
+	std::vector<TDT::Face_handle> created;
+	circle_batch circles;
+
+	// Where the last point went in, to start looking for the next one from
+	TDT::Face_handle hint;
+
+	/**
+	 * Move p (in [0,1)) to where it is relative to the square. Returns false
+	 * if it isn't in the region.
+	 */
+	bool local(vec2 p, vec2 &moved) const;
+
+	/**
+	 * Is this (local) point in the square?
+	 */
+	bool owns(vec2 p) const;
+
+	/**
+	 * Insert a local point, fix up the queue.
+	 */
+	void insert(vec2 p, double r2, TDT::Face_handle start);
+
+	/**
+	 * Queue up the faces in created that are finite and have their centers
+	 * in the square.
+	 */
+	void enqueue_created();
+};
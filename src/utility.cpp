@@ -17,7 +17,7 @@
  * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include "main.hpp"
+#include "ivs.hpp"
 
 double signed_area(vec2 a, vec2 b, vec2 c)
 {
@@ -42,7 +42,7 @@ bool line_line_intersection(
 {
 	auto det = (v0.x * v1.y - v0.y * v1.x);
 
-	if (abs(det) < 0.0000001) {
+	if (std::abs(det) < 0.0000001) {
 		m0 = NAN;
 		m1 = NAN;
 
@@ -50,7 +50,7 @@ bool line_line_intersection(
 	} else {
 		m0 = ((p0.y - p1.y) * v1.x - (p0.x - p1.x) * v1.y) / det;
 
-		if (abs(v1.x) >= 0.001f) {
+		if (std::abs(v1.x) >= 0.001f) {
 			m1 = (p0.x + m0*v0.x - p1.x) / v1.x;
 		} else {
 			m1 = (p0.y + m0*v0.y - p1.y) / v1.y;
@@ -0,0 +1,269 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Voronoi cells from the final triangulation. The Voronoi cell of a point is
+ * the polygon through the circumcenters of the faces around it, in the order
+ * the faces go around the point, same as the dual the drawer uses. CGAL
+ * circulates the faces counterclockwise, and each face hands us its corners
+ * in some periodic copy, so the circumcenter relative to the point's corner
+ * in that copy is where the cell's corner is relative to the point, whichever
+ * copy it was. The area is then the shoelace formula over those, and the
+ * neighbors come from the same circulation for free.
+ *
+ * The triangulation doesn't know the ranks of its vertices, so the points are
+ * sorted by position and the ranks are found with a binary search. Every point
+ * is looked up once in a serial pass to line the vertices up by rank, and the
+ * cells are then swept in parallel in chunks of ranks, which only read the
+ * triangulation. The neighbors are done in two parallel passes, one to count
+ * them (for the offsets) and one to fill them in, so they end up in one array
+ * without any merging.
+ */
+
+#include "voronoi_cells.hpp"
+#include "worker_pool.hpp"
+
+#include <cstring>
+
+static const char CELLS_MAGIC[4] = { 'I', 'V', 'S', 'V' };
+static const uint32_t CELLS_VERSION = 1;
+static const uint32_t CELLS_BYTE_ORDER = 0x01020304;
+
+// Ranks per chunk of the parallel sweeps
+static const size_t CHUNK_SIZE = 4096;
+
+/**
+ * The points sorted by position, for finding the rank of a vertex.
+ */
+class rank_lookup
+{
+public:
+	explicit rank_lookup(const std::vector<vec2> &points)
+	{
+		entries.reserve(points.size());
+
+		for (uint32_t k = 0; k < points.size(); k++) {
+			entries.push_back(entry { points[k].x, points[k].y, k });
+		}
+
+		std::sort(entries.begin(), entries.end());
+	}
+
+	/**
+	 * The rank of the point at p, or false if there isn't one there.
+	 */
+	bool find(const PDT::Point &p, uint32_t &rank) const
+	{
+		entry key { p.x(), p.y(), 0 };
+		auto it = std::lower_bound(entries.begin(), entries.end(), key);
+
+		if (it == entries.end() || it->x != key.x || it->y != key.y) return false;
+
+		rank = it->rank;
+		return true;
+	}
+
+private:
+	struct entry {
+		double x, y;
+		uint32_t rank;
+
+		bool operator<(const entry &e) const
+		{
+			return x != e.x ? x < e.x : y < e.y;
+		}
+	};
+
+	std::vector<entry> entries;
+};
+
+/**
+ * Area of the Voronoi cell of a vertex. If neighbors isn't null, the ranks of
+ * the neighboring vertices go there too, counterclockwise.
+ */
+static double cell_area(
+	const PDT &trig,
+	PDT::Vertex_handle vertex,
+	const rank_lookup &ranks,
+	uint32_t *neighbors)
+{
+	auto fb = trig.incident_faces(vertex);
+	auto fc = fb;
+
+	vec2 first, last;
+	double area2 = 0.0;
+	bool started = false;
+
+	do {
+		int i = fc->index(vertex);
+		auto triangle = trig.periodic_triangle(fc);
+
+		vec2 p[3];
+
+		for (int k = 0; k < 3; k++) {
+			p[k] = point(trig, triangle[k]);
+		}
+
+		vec2 center;
+		double r2;
+		circumcircle(p[0], p[1], p[2], center, r2);
+
+		// The corner of the cell, relative to the point
+		auto corner = center - p[i];
+
+		if (started) {
+			area2 += last.x * corner.y - last.y * corner.x;
+		} else {
+			first = corner;
+			started = true;
+		}
+
+		last = corner;
+
+		if (neighbors) {
+			// Every neighbor comes right after us in exactly one face
+			uint32_t rank = 0;
+			ranks.find(fc->vertex(PDT::ccw(i))->point(), rank);
+			*neighbors++ = rank;
+		}
+	} while (++fc != fb);
+
+	area2 += last.x * first.y - last.y * first.x;
+
+	return 0.5 * area2;
+}
+
+/**
+ * Number of faces (which is the number of neighbors) around a vertex.
+ */
+static uint32_t degree(const PDT &trig, PDT::Vertex_handle vertex)
+{
+	auto fb = trig.incident_faces(vertex);
+	auto fc = fb;
+	uint32_t count = 0;
+
+	do {
+		count++;
+	} while (++fc != fb);
+
+	return count;
+}
+
+bool compute_voronoi_cells(
+	const PDT &trig,
+	const std::vector<vec2> &points,
+	bool neighbors,
+	uint32_t threads,
+	voronoi_cells &cells)
+{
+	if (!trig.is_1_cover()) {
+		std::cerr << "Too few points for Voronoi cells, the triangulation isn't in one-sheet mode" << std::endl;
+		return false;
+	}
+
+	if (trig.number_of_vertices() != points.size()) {
+		std::cerr << "The triangulation has " << trig.number_of_vertices()
+			<< " points, expected " << points.size() << std::endl;
+		return false;
+	}
+
+	size_t n = points.size();
+	rank_lookup ranks { points };
+	std::vector<PDT::Vertex_handle> vertices(n);
+
+	for (auto v = trig.vertices_begin(); v != trig.vertices_end(); ++v) {
+		uint32_t rank;
+
+		if (!ranks.find(v->point(), rank) || vertices[rank] != PDT::Vertex_handle()) {
+			std::cerr << "The triangulation doesn't have the same points as the set" << std::endl;
+			return false;
+		}
+
+		vertices[rank] = v;
+	}
+
+	worker_pool pool { threads };
+	size_t chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	cells.area.assign(n, 0.0);
+	cells.offsets.clear();
+	cells.neighbors.clear();
+
+	if (neighbors) {
+		cells.offsets.assign(n + 1, 0);
+
+		pool.parallel_for(chunks, [&](size_t c) {
+			for (size_t k = c * CHUNK_SIZE; k < std::min(n, (c + 1) * CHUNK_SIZE); k++) {
+				cells.offsets[k + 1] = degree(trig, vertices[k]);
+			}
+		});
+
+		for (size_t k = 0; k < n; k++) {
+			cells.offsets[k + 1] += cells.offsets[k];
+		}
+
+		cells.neighbors.resize(cells.offsets[n]);
+	}
+
+	pool.parallel_for(chunks, [&](size_t c) {
+		for (size_t k = c * CHUNK_SIZE; k < std::min(n, (c + 1) * CHUNK_SIZE); k++) {
+			auto out = neighbors ? &cells.neighbors[cells.offsets[k]] : nullptr;
+			cells.area[k] = cell_area(trig, vertices[k], ranks, out);
+		}
+	});
+
+	return true;
+}
+
+bool write_voronoi_cells(const std::string &file, const voronoi_cells &cells)
+{
+	std::ofstream out { file, std::ios::out | std::ios::binary };
+
+	if (!out) {
+		std::cerr << "Failed to open " << file << std::endl;
+		return false;
+	}
+
+	bool neighbors = !cells.offsets.empty();
+
+	voronoi_cells_header header;
+	memcpy(header.magic, CELLS_MAGIC, sizeof(header.magic));
+	header.version = CELLS_VERSION;
+	header.byte_order = CELLS_BYTE_ORDER;
+	header.point_count = (uint32_t)cells.area.size();
+	header.flags = neighbors ? VORONOI_CELLS_NEIGHBORS : 0;
+	header.reserved = 0;
+
+	out.write((const char *)&header, sizeof(header));
+	out.write((const char *)cells.area.data(), cells.area.size() * sizeof(double));
+
+	if (neighbors) {
+		out.write((const char *)cells.offsets.data(), cells.offsets.size() * sizeof(uint64_t));
+		out.write((const char *)cells.neighbors.data(), cells.neighbors.size() * sizeof(uint32_t));
+	}
+
+	out.flush();
+
+	if (!out) {
+		std::cerr << "Failed to write " << file << std::endl;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,92 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Voronoi cell files: the area of the Voronoi cell of every point of a set, and
+ * optionally the Delaunay neighbors of every point, computed from the final
+ * triangulation and written next to the point file. Stipplers that scale the
+ * dots by cell area want these, and so does checking that the rank of a point
+ * really is inversely proportional to the area of its cell.
+ *
+ * The layout is columnar, so that each column can be memory mapped and used as
+ * a plain array:
+ *
+ *   voronoi_cells_header
+ *   double area[point_count]            cell area of every point, by rank
+ *   uint64_t offsets[point_count + 1]   where the neighbors of each point
+ *                                       start (only with neighbors)
+ *   uint32_t neighbors[offsets[point_count]]
+ *                                       ranks of the neighbors of every point,
+ *                                       counterclockwise (only with neighbors)
+ *
+ * That's compressed sparse row form for the neighbors: the neighbors of point
+ * k are neighbors[offsets[k]] to neighbors[offsets[k + 1] - 1]. All in native
+ * byte order (the header has a marker to check that it matches), and every
+ * column is 8-byte aligned.
+ */
+
+#pragma once
+
+#include "ivs.hpp"
+
+struct voronoi_cells_header {
+	char magic[4];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t point_count;
+
+	// VORONOI_CELLS_NEIGHBORS if the neighbor columns are there
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(voronoi_cells_header) == 24, "The header is part of the file format");
+
+constexpr uint32_t VORONOI_CELLS_NEIGHBORS = 1;
+
+/**
+ * The contents of a cell file, by rank. offsets and neighbors are empty if
+ * the neighbors weren't asked for.
+ */
+struct voronoi_cells {
+	std::vector<double> area;
+	std::vector<uint64_t> offsets;
+	std::vector<uint32_t> neighbors;
+};
+
+/**
+ * Compute the cells of the points of a triangulation. points are the same
+ * points, in rank order (exactly the ones that were inserted, every one of
+ * them), so that the cells can be put in rank order too. The triangulation
+ * has to be in one-sheet mode, which it is once there are a few dozen points.
+ * threads is the number of threads to use, 0 for one per hardware thread.
+ * Returns false, and complains on stderr, if the points don't match.
+ */
+bool compute_voronoi_cells(
+	const PDT &trig,
+	const std::vector<vec2> &points,
+	bool neighbors,
+	uint32_t threads,
+	voronoi_cells &cells);
+
+/**
+ * Write cells to a file. Returns false (after complaining to stderr) if that
+ * didn't work.
+ */
+bool write_voronoi_cells(const std::string &file, const voronoi_cells &cells);
@@ -0,0 +1,114 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include "worker_pool.hpp"
+
+worker_pool::worker_pool(uint32_t threads)
+	: job { nullptr }
+	, job_count { 0 }
+	, next { 0 }
+	, generation { 0 }
+	, busy { 0 }
+	, stopping { false }
+{
+	if (threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (uint32_t i = 1; i < threads; i++) {
+		workers.emplace_back([this] { worker_main(); });
+	}
+}
+
+worker_pool::~worker_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock { mutex };
+		stopping = true;
+	}
+
+	wake.notify_all();
+
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void worker_pool::parallel_for(size_t count, const std::function<void(size_t)> &fn)
+{
+	// Not worth waking anyone up for
+	if (workers.empty() || count < 2) {
+		for (size_t i = 0; i < count; i++) fn(i);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock { mutex };
+
+		job = &fn;
+		job_count = count;
+		next = 0;
+		busy = (uint32_t)workers.size();
+		generation++;
+	}
+
+	wake.notify_all();
+
+	// Pitch in while we wait
+	work();
+
+	std::unique_lock<std::mutex> lock { mutex };
+	done.wait(lock, [this] { return busy == 0; });
+
+	job = nullptr;
+}
+
+void worker_pool::work()
+{
+	size_t i;
+
+	while ((i = next.fetch_add(1, std::memory_order_relaxed)) < job_count) {
+		(*job)(i);
+	}
+}
+
+void worker_pool::worker_main()
+{
+	uint64_t seen = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock { mutex };
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+
+			if (stopping) return;
+
+			seen = generation;
+		}
+
+		work();
+
+		std::lock_guard<std::mutex> lock { mutex };
+
+		if (--busy == 0) {
+			done.notify_one();
+		}
+	}
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright 2020 Oskar Sigvardsson
+ *
+ * This file is part of ivs-generator.
+ *
+ * ivs-generator is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * ivs-generator is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * ivs-generator. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/**
+ * A tiny pool of worker threads for running loops in parallel. The generator
+ * runs a lot of small parallel loops (thousands per second), so spinning up
+ * threads for every one of them is out of the question. These threads stick
+ * around and sleep until there's something to do.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class worker_pool
+{
+public:
+	/**
+	 * Create a pool where threads in total run the loops. The thread calling
+	 * parallel_for counts as one of them, so this starts threads - 1 workers.
+	 * Zero means one per hardware thread.
+	 */
+	explicit worker_pool(uint32_t threads);
+	~worker_pool();
+
+	worker_pool(const worker_pool&) = delete;
+	worker_pool &operator=(const worker_pool&) = delete;
+
+	/**
+	 * Number of threads that run the loops (including the caller).
+	 */
+	uint32_t size() const { return (uint32_t)workers.size() + 1; }
+
+	/**
+	 * Call fn(i) for every i in [0, count), spread out over the threads, and
+	 * wait for all of them to finish. The order is whatever it happens to be.
+	 */
+	void parallel_for(size_t count, const std::function<void(size_t)> &fn);
+
+private:
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+
+	// The current loop. generation is bumped for every new loop so the
+	// workers can tell it apart from the one they just finished.
+	const std::function<void(size_t)> *job;
+	size_t job_count;
+	std::atomic<size_t> next;
+	uint64_t generation;
+	uint32_t busy;
+	bool stopping;
+
+	void work();
+	void worker_main();
+};